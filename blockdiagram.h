@@ -0,0 +1,417 @@
+#ifndef BLOCKDIAGRAM_H
+#define BLOCKDIAGRAM_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cairo-symbol.h"
+#include "router.h"
+#include "svparse.h"
+
+// Symbol of a parsed module: one section with a pin per port
+inline Symbol& moduleSymbol(SymbolLibrary& library, const SvModule& module) {
+    Symbol& symbol = library.emplaceSymbol(module.name);
+    Section& section = symbol.emplaceSection();
+    section.reservePins(module.ports.size());
+    for (const auto& port: module.ports) {
+        section.emplacePin(port.name, port.direction, port.is_bus, port.type);
+    }
+    return symbol;
+}
+
+// Symbols for modules, built and laid out once however often a module is
+// instantiated, along with where each port's wire attaches
+class ModuleSymbols {
+public:
+    struct Terminal {
+        double x, y;
+        PinDirection direction;
+    };
+
+    struct Entry {
+        size_t symbol;
+        Cairo::Rectangle frame;
+        std::vector<std::string> ports;
+        std::unordered_map<std::string, Terminal> terminals;
+    };
+private:
+    SymbolLibrary& library;
+    std::unordered_map<std::string, const SvModule*> modules;
+    std::unordered_map<std::string, Entry> entries;
+
+    Entry& measure(const std::string& name, Symbol& symbol) {
+        Entry& entry = entries[name];
+        entry.symbol = library.getSymbols().size()-1;
+        entry.frame = symbol.frame();
+        symbol.forEachSection(symbol.frame(), [&](const Section& section, const Cairo::Rectangle& r) {
+            section.forEachPin(r, [&](const Pin& pin, const Cairo::Rectangle& pin_rect) {
+                Terminal terminal = { 0, 0, pin.getDirection() };
+                Pin::stemEnd(pin_rect, pin.getDirection(), pin.nameRun().extents, terminal.x, terminal.y);
+                entry.terminals.emplace(std::string(pin.getName()), terminal);
+            });
+        });
+        for (size_t i = 0; i < symbol.sectionCount(); i++) {
+            for (size_t j = 0; j < symbol.getSection(i).pinCount(); j++) {
+                entry.ports.emplace_back(symbol.getSection(i).getPin(j).getName());
+            }
+        }
+        return entry;
+    }
+public:
+    ModuleSymbols(SymbolLibrary& _library, const std::vector<SvModule>& _modules) : library(_library) {
+        for (const auto& module: _modules) {
+            modules.emplace(module.name, &module);
+        }
+    }
+
+    const Entry& get(const SvModule& module) {
+        auto it = entries.find(module.name);
+        if (it != entries.end()) {
+            return it->second;
+        }
+        return measure(module.name, moduleSymbol(library, module));
+    }
+
+    // Modules without a definition get bidirectional ports named after the
+    // connections of their first instance
+    const Entry& get(const SvInstance& instance) {
+        auto module = modules.find(instance.module);
+        if (module != modules.end()) {
+            return get(*module->second);
+        }
+        auto it = entries.find(instance.module);
+        if (it != entries.end()) {
+            return it->second;
+        }
+        SvModule stub { instance.module, {}, {} };
+        for (size_t i = 0; i < instance.connections.size(); i++) {
+            const auto& port = instance.connections[i].port;
+            if (port != "*") {
+                stub.ports.push_back({ port.empty() ? "p" + std::to_string(i) : port, INOUT, "", false });
+            }
+        }
+        return measure(instance.module, moduleSymbol(library, stub));
+    }
+
+    const Symbol& getSymbol(const Entry& entry) const {
+        return library.getSymbols()[entry.symbol];
+    }
+};
+
+// Instances of a module placed in layers from drivers to loads, Sugiyama
+// style: cycles are broken at DFS back edges, each instance goes one layer
+// right of its furthest driver, and the order within layers comes from a few
+// barycenter sweeps. Nets are drawn as orthogonal wires from each driving
+// output to every input on the same net, routed around the symbol frames.
+// Nets no output drives, such as those between undefined modules whose ports
+// are all inout, chain their inout ends in order and feed inputs from the
+// first one.
+class BlockDiagram {
+    static constexpr double kLayerSpacing = 80;
+    static constexpr double kNodeSpacing = 30;
+    static constexpr double kLabelSpacing = 4;
+    static constexpr int kSweeps = 4;
+
+    struct Node {
+        const SvInstance* instance;
+        const ModuleSymbols::Entry* module;
+        int layer = 0;
+        double x = 0, y = 0;
+    };
+
+    struct Wire {
+        size_t from, to;
+        ModuleSymbols::Terminal from_terminal, to_terminal;
+    };
+
+    ModuleSymbols& modules;
+    std::vector<Node> nodes;
+    std::vector<Wire> wires;
+    std::vector<std::vector<WireRouter::Point>> routes;
+    std::vector<std::vector<size_t>> successors, predecessors;
+    std::vector<std::vector<size_t>> layers;
+    double width = 0, height = 0;
+
+    static double labelHeight() {
+        return Pin::height()+kLabelSpacing;
+    }
+
+    void connect() {
+        struct End {
+            size_t node;
+            ModuleSymbols::Terminal terminal;
+        };
+        struct Net {
+            std::vector<End> drivers, loads;
+        };
+        std::unordered_map<std::string, Net> nets;
+        auto attach = [&](size_t node, const std::string& port, const std::string& net) {
+            auto terminal = nodes[node].module->terminals.find(port);
+            if (net.empty() || terminal == nodes[node].module->terminals.end()) {
+                return;
+            }
+            Net& n = nets[net];
+            (terminal->second.direction == OUT ? n.drivers : n.loads).push_back({ node, terminal->second });
+        };
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const auto& ports = nodes[i].module->ports;
+            std::unordered_set<std::string> named;
+            bool wildcard = false;
+            for (size_t j = 0; j < nodes[i].instance->connections.size(); j++) {
+                const auto& connection = nodes[i].instance->connections[j];
+                if (connection.port == "*") {
+                    wildcard = true;
+                } else if (connection.port.empty()) {
+                    if (j < ports.size()) {
+                        attach(i, ports[j], connection.net);
+                    }
+                } else {
+                    named.insert(connection.port);
+                    attach(i, connection.port, connection.net);
+                }
+            }
+            if (wildcard) {
+                for (const auto& port: ports) {
+                    if (!named.count(port)) {
+                        attach(i, port, port);
+                    }
+                }
+            }
+        }
+
+        successors.assign(nodes.size(), {});
+        predecessors.assign(nodes.size(), {});
+        auto wire = [&](const End& from, const End& to) {
+            wires.push_back({ from.node, to.node, from.terminal, to.terminal });
+            if (from.node != to.node) {
+                successors[from.node].push_back(to.node);
+                predecessors[to.node].push_back(from.node);
+            }
+        };
+        for (const auto& net: nets) {
+            for (const auto& driver: net.second.drivers) {
+                for (const auto& load: net.second.loads) {
+                    wire(driver, load);
+                }
+            }
+            if (!net.second.drivers.empty()) {
+                continue;
+            }
+            const End* first = nullptr;
+            const End* previous = nullptr;
+            for (const auto& end: net.second.loads) {
+                if (end.terminal.direction == INOUT) {
+                    if (previous) {
+                        wire(*previous, end);
+                    } else {
+                        first = &end;
+                    }
+                    previous = &end;
+                }
+            }
+            for (const auto& end: net.second.loads) {
+                if (first && end.terminal.direction == IN) {
+                    wire(*first, end);
+                }
+            }
+        }
+    }
+
+    // Longest path layering over the graph with DFS back edges left out
+    void assignLayers() {
+        enum { NEW, ACTIVE, DONE };
+        std::vector<char> state(nodes.size(), NEW);
+        std::vector<size_t> finished;
+        finished.reserve(nodes.size());
+        std::vector<std::pair<size_t, size_t>> stack;
+        for (size_t root = 0; root < nodes.size(); root++) {
+            if (state[root] != NEW) {
+                continue;
+            }
+            stack.push_back({ root, 0 });
+            state[root] = ACTIVE;
+            while (!stack.empty()) {
+                auto& top = stack.back();
+                if (top.second < successors[top.first].size()) {
+                    size_t next = successors[top.first][top.second++];
+                    if (state[next] == NEW) {
+                        state[next] = ACTIVE;
+                        stack.push_back({ next, 0 });
+                    }
+                } else {
+                    state[top.first] = DONE;
+                    finished.push_back(top.first);
+                    stack.pop_back();
+                }
+            }
+        }
+
+        // Reverse finishing order is topological once back edges are ignored
+        std::vector<size_t> rank(nodes.size());
+        for (size_t i = 0; i < finished.size(); i++) {
+            rank[finished[i]] = finished.size()-i;
+        }
+        int layer_count = 0;
+        for (size_t i = finished.size(); i-- > 0; ) {
+            size_t node = finished[i];
+            for (size_t next: successors[node]) {
+                if (rank[next] > rank[node]) {
+                    nodes[next].layer = std::max(nodes[next].layer, nodes[node].layer+1);
+                }
+            }
+            layer_count = std::max(layer_count, nodes[node].layer+1);
+        }
+        layers.assign(layer_count, {});
+        for (size_t i = 0; i < nodes.size(); i++) {
+            layers[nodes[i].layer].push_back(i);
+        }
+    }
+
+    // Barycenter heuristic: sort each layer by the mean position of its
+    // neighbours, sweeping down the layers and back up
+    void orderLayers() {
+        std::vector<double> position(nodes.size());
+        auto number = [&](const std::vector<size_t>& layer) {
+            for (size_t i = 0; i < layer.size(); i++) {
+                position[layer[i]] = i;
+            }
+        };
+        for (const auto& layer: layers) {
+            number(layer);
+        }
+        std::vector<double> key(nodes.size());
+        auto sweep = [&](std::vector<size_t>& layer, const std::vector<std::vector<size_t>>& neighbours) {
+            for (size_t node: layer) {
+                double sum = 0;
+                for (size_t other: neighbours[node]) {
+                    sum += position[other];
+                }
+                key[node] = neighbours[node].empty() ? position[node] : sum/neighbours[node].size();
+            }
+            std::stable_sort(layer.begin(), layer.end(), [&](size_t a, size_t b) {
+                return key[a] < key[b];
+            });
+            number(layer);
+        };
+        for (int i = 0; i < kSweeps; i++) {
+            for (size_t l = 1; l < layers.size(); l++) {
+                sweep(layers[l], predecessors);
+            }
+            for (size_t l = layers.size(); l-- > 1; ) {
+                sweep(layers[l-1], successors);
+            }
+        }
+    }
+
+    void place() {
+        double x = 0;
+        std::vector<double> layer_heights;
+        for (const auto& layer: layers) {
+            double layer_width = 0, y = 0;
+            for (size_t node: layer) {
+                const Symbol& symbol = modules.getSymbol(*nodes[node].module);
+                nodes[node].x = x;
+                nodes[node].y = y;
+                layer_width = std::max(layer_width, symbol.width());
+                y += labelHeight()+symbol.height()+kNodeSpacing;
+            }
+            layer_heights.push_back(std::max(0.0, y-kNodeSpacing));
+            x += layer_width+kLayerSpacing;
+        }
+        width = std::max(0.0, x-kLayerSpacing);
+        height = layer_heights.empty() ? 0 : *std::max_element(layer_heights.begin(), layer_heights.end());
+
+        // Center the layers on each other
+        for (size_t l = 0; l < layers.size(); l++) {
+            for (size_t node: layers[l]) {
+                nodes[node].y += (height-layer_heights[l])/2;
+            }
+        }
+    }
+
+    void terminalPosition(size_t node, const ModuleSymbols::Terminal& terminal, double& x, double& y) const {
+        x = nodes[node].x+terminal.x;
+        y = nodes[node].y+labelHeight()+terminal.y;
+    }
+
+    void route() {
+        TraceSpan span("route", "layout");
+        WireRouter router;
+        for (const auto& node: nodes) {
+            const auto& frame = node.module->frame;
+            router.addObstacle({ node.x+frame.x, node.y+labelHeight()+frame.y, frame.width, frame.height });
+        }
+        std::vector<std::pair<WireRouter::Point, WireRouter::Point>> connections;
+        connections.reserve(wires.size());
+        for (const auto& wire: wires) {
+            WireRouter::Point from, to;
+            terminalPosition(wire.from, wire.from_terminal, from.x, from.y);
+            terminalPosition(wire.to, wire.to_terminal, to.x, to.y);
+            connections.push_back({ from, to });
+        }
+        routes = router.route(connections);
+    }
+
+    void drawWires(Cairo::RefPtr<Cairo::Context> ctx) const {
+        ctx->save();
+        ctx->set_line_width(0.5);
+        for (const auto& points: routes) {
+            ctx->move_to(points.front().x, points.front().y);
+            for (size_t i = 1; i < points.size(); i++) {
+                ctx->line_to(points[i].x, points[i].y);
+            }
+            ctx->stroke();
+        }
+        ctx->restore();
+    }
+public:
+    BlockDiagram(const SvModule& top, ModuleSymbols& _modules) : modules(_modules) {
+        nodes.reserve(top.instances.size());
+        for (const auto& instance: top.instances) {
+            nodes.push_back({ &instance, &modules.get(instance) });
+        }
+        connect();
+        assignLayers();
+        orderLayers();
+        place();
+        route();
+    }
+
+    double getWidth() const {
+        return width;
+    }
+
+    double getHeight() const {
+        return height;
+    }
+
+    size_t instanceCount() const {
+        return nodes.size();
+    }
+
+    size_t wireCount() const {
+        return wires.size();
+    }
+
+    // Instances sharing a module are drawn from one recorded body through bodies
+    void draw(Cairo::RefPtr<Cairo::Context> ctx, SymbolBodyCache& bodies, const RenderOptions& options = RenderOptions()) const {
+        bool greeked = isGreeked(ctx, options);
+        auto measure = measureContext();
+        for (const auto& node: nodes) {
+            const Symbol& symbol = modules.getSymbol(*node.module);
+            double label_y = node.y+labelHeight()-kLabelSpacing;
+            if (greeked) {
+                drawGreekedText(ctx, node.x, label_y, TextShaper::instance().shape(measure, node.instance->name)->extents);
+            } else {
+                drawText(ctx, node.x, label_y, TextShaper::instance().shape(measure, node.instance->name)->view());
+            }
+            ctx->save();
+            ctx->translate(node.x, node.y+labelHeight());
+            bodies.draw(ctx, symbol, options);
+            ctx->restore();
+        }
+        drawWires(ctx);
+    }
+};
+
+#endif
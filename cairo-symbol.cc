@@ -1,268 +1,470 @@
 #include <string>
+#include <vector>
 #include <iostream>
-#include <cairommconfig.h>
-#include <cairomm/context.h>
-#include <cairomm/surface.h>
-#include <cmath>
-
-void drawRTLText(Cairo::RefPtr<Cairo::Context> ctx, const std::string& str) {
-    Cairo::TextExtents extents;
-    ctx->get_text_extents(str, extents);
-    ctx->rel_move_to(-extents.width, 0);
-    ctx->show_text(str);
+#include <fstream>
+#include <deque>
+#include <memory>
+#include "cairo-symbol.h"
+#include "csym.h"
+#include "symboldiff.h"
+#include "golden.h"
+#include "blockdiagram.h"
+#include "kicad.h"
+#include "mappedfile.h"
+#include "vhdlparse.h"
+#include "ipxact.h"
+#include "liberty.h"
+#include "spice.h"
+
+// Example symbols of varying shape, for trying out multi-symbol output
+void exampleSymbols(SymbolLibrary& library, int count) {
+    TraceSpan span("parse", "parse");
+    library.reserve(count);
+    for (int i = 0; i < count; i++) {
+        Section& pins = library.emplaceSymbol("module_" + std::to_string(i)).emplaceSection();
+        for (int j = 0; j < 1+(i*7)%13; j++) {
+            pins.emplacePin("i_data" + std::to_string(j), IN, j%3 == 0, (j%3 == 0) ? "logic [31:0]" : "logic");
+        }
+        for (int j = 0; j < 1+(i*5)%9; j++) {
+            pins.emplacePin("o_result" + std::to_string(j), OUT, j%2 == 0, (j%2 == 0) ? "logic [7:0]" : "logic");
+        }
+    }
 }
 
-enum PinDirection {
-    IN,
-    OUT,
-    INOUT
-};
-
-class Pin {
-    static constexpr double kStemLength = 15;
-    static constexpr double kWireStemWidth = 1;
-    static constexpr double kBusStemWidth = 2;
-    static constexpr double kTextPadding = 5;
-
-    PinDirection direction;
-    std::string name;
-    std::string type;
-    bool is_bus;
-public:
-    Pin(std::string _name, PinDirection _direction, bool _is_bus = false, std::string _type = "cc") :
-        name(_name), direction(_direction), is_bus(_is_bus), type(_type) { }
-
-    void draw(Cairo::RefPtr<Cairo::Context> ctx, const Cairo::Rectangle& pos) const {
-        ctx->save();
-
-        // Draw pin name
-        ctx->save();
-        if (direction == IN) {
-            ctx->move_to(pos.x+kTextPadding, pos.y);
-            ctx->show_text(name);
+int main(int argc, char** argv)
+{
+#ifdef CAIRO_HAS_PDF_SURFACE
+    std::string filename;
+    double scale = 1;
+    int demo_count = 0;
+    bool pack = false;
+    std::string tiles;
+    OutputFormat format = PDF;
+    bool compile = false;
+    bool kicad = false;
+    std::string diff_old, diff_new;
+    std::string golden;
+    bool update_golden = false;
+    int tolerance = 0;
+    std::string trace;
+    double max_label_width = 0;
+    std::vector<std::string> inputs;
+    std::vector<std::string> sources;
+    std::vector<std::string> components;
+    std::vector<std::string> libraries;
+    std::vector<std::string> netlists;
+    std::string block;
+    RenderOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--scale" && i+1 < argc) {
+            scale = std::stod(argv[++i]);
+        } else if (arg == "--lod" && i+1 < argc) {
+            options.lod_threshold = std::stod(argv[++i]);
+        } else if (arg == "--demo" && i+1 < argc) {
+            demo_count = std::stoi(argv[++i]);
+        } else if (arg == "--max-label-width" && i+1 < argc) {
+            max_label_width = std::stod(argv[++i]);
+        } else if (arg == "--preview") {
+            options.profile = PREVIEW;
+        } else if (arg == "--pack") {
+            pack = true;
+        } else if (arg == "--tiles" && i+1 < argc) {
+            tiles = argv[++i];
+        } else if (arg == "-o" && i+1 < argc) {
+            filename = argv[++i];
+        } else if (arg == "--format" && i+1 < argc && (argv[i+1] == std::string("svg") || argv[i+1] == std::string("png"))) {
+            format = (argv[++i] == std::string("svg")) ? SVG : PNG;
+        } else if (arg == "--compile") {
+            compile = true;
+        } else if (arg == "--kicad") {
+            kicad = true;
+        } else if (arg == "--diff" && i+2 < argc) {
+            diff_old = argv[++i];
+            diff_new = argv[++i];
+        } else if (arg == "--golden" && i+1 < argc) {
+            golden = argv[++i];
+        } else if (arg == "--update-golden") {
+            update_golden = true;
+        } else if (arg == "--tolerance" && i+1 < argc) {
+            tolerance = std::clamp(std::stoi(argv[++i]), 0, 255);
+        } else if (arg == "--trace" && i+1 < argc) {
+            trace = argv[++i];
+        } else if (arg == "--block" && i+1 < argc) {
+            block = argv[++i];
+        } else if (arg.size() > 5 && arg.compare(arg.size()-5, 5, ".csym") == 0) {
+            inputs.push_back(arg);
+        } else if ((arg.size() > 3 && arg.compare(arg.size()-3, 3, ".sv") == 0) ||
+                   (arg.size() > 2 && arg.compare(arg.size()-2, 2, ".v") == 0) ||
+                   (arg.size() > 4 && arg.compare(arg.size()-4, 4, ".vhd") == 0) ||
+                   (arg.size() > 5 && arg.compare(arg.size()-5, 5, ".vhdl") == 0)) {
+            sources.push_back(arg);
+        } else if (arg.size() > 4 && arg.compare(arg.size()-4, 4, ".xml") == 0) {
+            components.push_back(arg);
+        } else if (arg.size() > 4 && arg.compare(arg.size()-4, 4, ".lib") == 0) {
+            libraries.push_back(arg);
+        } else if ((arg.size() > 3 && arg.compare(arg.size()-3, 3, ".sp") == 0) ||
+                   (arg.size() > 4 && arg.compare(arg.size()-4, 4, ".spi") == 0) ||
+                   (arg.size() > 6 && arg.compare(arg.size()-6, 6, ".spice") == 0) ||
+                   (arg.size() > 4 && arg.compare(arg.size()-4, 4, ".cir") == 0) ||
+                   (arg.size() > 4 && arg.compare(arg.size()-4, 4, ".cdl") == 0)) {
+            netlists.push_back(arg);
         } else {
-            ctx->move_to(pos.x-kTextPadding, pos.y);
-            drawRTLText(ctx, name);
+            std::cerr << "Usage: " << argv[0] << " [-o file|-] [--format svg|png] [--scale factor] [--lod pixels-per-unit] [--max-label-width units] [--preview] [--demo count] [--pack] [--tiles name] [--compile] [--kicad] [--diff old.csym new.csym] [--golden dir [--update-golden] [--tolerance n]] [--trace file.json] [--block top] [file.csym|file.sv|file.vhd|file.xml|file.lib|file.sp...]" << std::endl;
+            return 1;
         }
-        ctx->close_path();
-        ctx->restore();
-
-        // Calculate stem alignment
-        Cairo::TextExtents extents;
-        ctx->get_text_extents(name, extents);
+    }
 
-        // Draw pin stem
-        ctx->save();
-        ctx->set_line_width((is_bus) ? kBusStemWidth : kWireStemWidth);
-        ctx->move_to(pos.x, pos.y+extents.y_bearing/2);
-        if (direction == IN) {
-            ctx->line_to(pos.x-kStemLength, pos.y+extents.y_bearing/2);
-        } else {
-            ctx->line_to(pos.x+kStemLength, pos.y+extents.y_bearing/2);
+    // Written when main returns, whichever mode ran
+    struct TraceWriter {
+        std::string filename;
+        ~TraceWriter() {
+            if (!filename.empty()) {
+                std::ofstream out(filename);
+                Tracer::instance().write(out);
+            }
         }
-        ctx->stroke();
-        ctx->restore();
+    } trace_writer { trace };
+    if (!trace.empty()) {
+        Tracer::instance().start();
+    }
 
-        // Draw pin type
-        ctx->save();
-        ctx->set_source_rgb(0.5, 0.5, 0.5);
-        if (direction == IN) {
-            ctx->move_to(pos.x-kTextPadding-kStemLength, pos.y);
-            drawRTLText(ctx, type);
-        } else {
-            ctx->move_to(pos.x+kTextPadding+kStemLength, pos.y);
-            ctx->show_text(type);
+    if (!diff_old.empty()) {
+        if (filename.empty()) {
+            filename = "diff";
+        }
+        try {
+            CsymFile old_file(diff_old), new_file(diff_new);
+            size_t changed = SymbolDiff(old_file, new_file).write(filename);
+            std::cout << changed << " changed symbols written to \"" << filename << "\"" << std::endl;
+            return 0;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
         }
-        ctx->restore();
-
-        ctx->restore();
     }
 
-    PinDirection getDirection() const {
-        return direction;
+    // Compiled symbols are drawn straight from the mapped files
+    std::vector<std::unique_ptr<CsymFile>> compiled;
+    if (!inputs.empty() && (pack || !tiles.empty() || format != PDF || compile || kicad)) {
+        std::cerr << ".csym input can only be rendered to PDF pages" << std::endl;
+        return 1;
     }
-
-    int innerWidth() const {
-        auto surface = Cairo::RecordingSurface::create();
-        auto cr = Cairo::Context::create(surface);
-        Cairo::TextExtents extents;
-        cr->get_text_extents(name, extents);
-        return kTextPadding+extents.width;
+    if (!inputs.empty() && (!sources.empty() || !components.empty() || !libraries.empty() || !netlists.empty() ||
+                            demo_count > 0 || !block.empty() || !golden.empty())) {
+        std::cerr << ".csym input can't be mixed with sources, --demo, --block or --golden" << std::endl;
+        return 1;
     }
-
-    int outerWidth() const {
-        auto surface = Cairo::RecordingSurface::create();
-        auto cr = Cairo::Context::create(surface);
-        Cairo::TextExtents extents;
-        cr->get_text_extents(type, extents);
-        return kStemLength+kTextPadding+extents.width;
+    for (const auto& input: inputs) {
+        TraceSpan span("parse", "parse");
+        try {
+            compiled.emplace_back(new CsymFile(input));
+            // Pages are drawn in the default font too
+            compiled.back()->checkFont(measureContext());
+        } catch (const std::exception& e) {
+            std::cerr << input << ": " << e.what() << std::endl;
+            return 1;
+        }
     }
 
-    static int height() {
-        auto surface = Cairo::RecordingSurface::create();
-        auto cr = Cairo::Context::create(surface);
-        Cairo::TextExtents extents;
-        cr->get_text_extents("Hello world", extents);
-        return extents.height;
+    // Liberty cells are parsed in the background from here on. Page by page
+    // PDF and KiCad output take them as they come, so drawing overlaps the
+    // parse; everything else waits for whole files.
+    std::vector<std::unique_ptr<LibertyReader>> cell_readers;
+    for (const auto& library: libraries) {
+        try {
+            cell_readers.emplace_back(new LibertyReader(library, max_label_width));
+        } catch (const std::exception& e) {
+            std::cerr << library << ": " << e.what() << std::endl;
+            return 1;
+        }
     }
-};
-
-class Section {
-    static constexpr double kTextSeparator = 10;
-    static constexpr double kTopBottomPadding = 10;
-    static constexpr double kBorderThickness = 1.5;
-    static constexpr double kPinSpacing = 5;
-
-    std::vector<Pin> pins;
-    std::string name;
-
-    int rows() const {
-        int left_rows = 0, right_rows = 0;
-        for (const auto& pin : pins) {
-            if (pin.getDirection() == IN) {
-                left_rows += 1;
-            } else {
-                right_rows += 1;
+    bool stream_cells = !pack && tiles.empty() && golden.empty() && !compile && format == PDF;
+    auto streamCells = [&](auto fn) {
+        for (size_t i = 0; i < cell_readers.size(); i++) {
+            try {
+                while (auto cell = cell_readers[i]->next()) {
+                    fn(std::move(*cell));
+                }
+            } catch (const std::exception& e) {
+                std::cerr << libraries[i] << ": " << e.what() << std::endl;
+                return false;
             }
         }
-        return (left_rows > right_rows) ? left_rows : right_rows;
+        return true;
+    };
+
+    // SystemVerilog modules and VHDL entities become symbols, or with --block
+    // the top module a block diagram
+    // All SystemVerilog sources make one compilation unit, sharing macros and packages
+    std::vector<SvModule> modules;
+    SvParser sv_parser;
+    for (const auto& source: sources) {
+        TraceSpan span("parse", "parse");
+        try {
+            MappedFile file(source);
+            bool vhdl = source.back() == 'd' || source.back() == 'l';
+            auto parsed = vhdl ? VhdlParser().parse(file.text()) : sv_parser.parse(file.text());
+            std::move(parsed.begin(), parsed.end(), std::back_inserter(modules));
+        } catch (const std::exception& e) {
+            std::cerr << source << ": " << e.what() << std::endl;
+            return 1;
+        }
     }
-public:
-    Section(std::string _name = "") : name(_name) {
-
+    if (!block.empty() && (pack || !tiles.empty() || format != PDF || compile || kicad || !golden.empty())) {
+        std::cerr << "--block draws a single PDF page" << std::endl;
+        return 1;
     }
-
-    void addPin(const Pin& pin) {
-        pins.push_back(pin);
+    if (!block.empty() && (!components.empty() || !libraries.empty() || !netlists.empty())) {
+        std::cerr << "--block takes SystemVerilog and VHDL sources only" << std::endl;
+        return 1;
     }
 
-    void draw(Cairo::RefPtr<Cairo::Context> ctx, const Cairo::Rectangle& pos) const {
-        ctx->save();
-
-        // Draw section rectangle
-        ctx->rectangle(pos.x, pos.y, pos.width, pos.height);
-        ctx->stroke();
-
-        std::vector<Pin> left_pins, right_pins;
-        std::copy_if (pins.begin(), pins.end(), std::back_inserter(left_pins), [](const Pin& pin){return pin.getDirection() == IN;} );
-        std::copy_if (pins.begin(), pins.end(), std::back_inserter(right_pins), [](const Pin& pin){return pin.getDirection() != IN;} );
-        Cairo::Rectangle pin_rect = {
-            .x = pos.x,
-            .y = pos.y+kTopBottomPadding
-        };
-        for (const auto& pin: left_pins) {
-            pin_rect.y += pin.height();
-            pin.draw(ctx, pin_rect);
-            pin_rect.y += kPinSpacing;
+    SymbolLibrary library;
+    library.setMaxNameWidth(max_label_width);
+    ModuleSymbols module_symbols(library, modules);
+    std::unique_ptr<BlockDiagram> diagram;
+    if (!block.empty()) {
+        auto top = std::find_if(modules.begin(), modules.end(), [&](const SvModule& module) {
+            return module.name == block;
+        });
+        if (top == modules.end()) {
+            std::cerr << "No module \"" << block << "\" in the sources" << std::endl;
+            return 1;
         }
-        pin_rect.x = pos.x+pos.width;
-        pin_rect.y = pos.y+kTopBottomPadding;
-        for (const auto& pin: right_pins) {
-            pin_rect.y += pin.height();
-            pin.draw(ctx, pin_rect);
-            pin_rect.y += kPinSpacing;
+        TraceSpan span("layout", "layout");
+        diagram.reset(new BlockDiagram(*top, module_symbols));
+    } else if (!modules.empty() || !components.empty() || !libraries.empty() || !netlists.empty()) {
+        for (const auto& module: modules) {
+            module_symbols.get(module);
         }
-
-        ctx->restore();
-    }
-
-    int height() const {
-        return kPinSpacing*(rows()-1)+rows()*Pin::height()+2*kTopBottomPadding;
+        // IP-XACT components, one symbol each with a section per bus interface
+        for (const auto& component: components) {
+            TraceSpan span("parse", "parse");
+            try {
+                MappedFile file(component);
+                IpxactImporter().import(library, file.text());
+            } catch (const std::exception& e) {
+                std::cerr << component << ": " << e.what() << std::endl;
+                return 1;
+            }
+        }
+        // SPICE subcircuits, with port directions from netlist.pins beside each
+        for (const auto& netlist: netlists) {
+            TraceSpan span("parse", "parse");
+            SpiceImporter importer;
+            std::string pins = netlist.substr(0, netlist.rfind('.')) + ".pins";
+            if (access(pins.c_str(), F_OK) == 0) {
+                try {
+                    MappedFile file(pins);
+                    importer.readDirections(file.text());
+                } catch (const std::exception& e) {
+                    std::cerr << pins << ": " << e.what() << std::endl;
+                    return 1;
+                }
+            }
+            try {
+                MappedFile file(netlist);
+                importer.import(library, file.text());
+            } catch (const std::exception& e) {
+                std::cerr << netlist << ": " << e.what() << std::endl;
+                return 1;
+            }
+        }
+        if (!stream_cells && !streamCells([&](Symbol&& cell) { library.addSymbol(std::move(cell)); })) {
+            return 1;
+        }
+    } else if (demo_count > 0) {
+        exampleSymbols(library, demo_count);
+    } else {
+        TraceSpan span("parse", "parse");
+        Pin pin1("i_foo", IN, true, "logic [15:0]"),
+            pin2("o_bar", OUT, false, "logic"),
+            pin3("i_foobar", IN, false, "logic"),
+            pin4("i_barfoo", IN, true, "logic [15:0]");
+        Section pins;
+        pins.addPin(pin1);
+        pins.addPin(pin2);
+        pins.addPin(pin3);
+        pins.addPin(pin4);
+        library.emplaceSymbol("My symbol").addSection(pins);
     }
+    const auto& symbols = library.getSymbols();
 
-    int minInnerWidth() const {
-        int leftInnerWidth = 0, rightInnerWidth = 0;
-        for (const auto& pin : pins) {
-            if (pin.innerWidth() > leftInnerWidth && pin.getDirection() == IN) {
-                leftInnerWidth = pin.innerWidth();
-            } else if (pin.innerWidth() > rightInnerWidth && pin.getDirection() == OUT) {
-                rightInnerWidth = pin.innerWidth();
-            }
+    {
+        TraceSpan span("layout", "layout");
+        for (const auto& symbol: symbols) {
+            symbol.width();
+            symbol.height();
         }
-        return leftInnerWidth+kTextSeparator+rightInnerWidth;
     }
 
-    int minOuterWidth() const {
-        int minOuterWidth = 0;
-        for (const auto& pin : pins) {
-            if (pin.outerWidth() > minOuterWidth) {
-                minOuterWidth = pin.outerWidth();
+    if (!golden.empty()) {
+        GoldenCheck check(symbols, golden, tolerance, options);
+        std::string diff_directory = filename.empty() ? "golden-diff" : filename;
+        std::vector<std::string> failed;
+        try {
+            if (update_golden) {
+                check.update();
+                std::cout << "Wrote " << symbols.size() << " golden images to \"" << golden << "\"" << std::endl;
+                return 0;
             }
+            failed = check.run(diff_directory);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        for (const auto& name: failed) {
+            std::cerr << name << " differs from its golden image" << std::endl;
         }
-        return minOuterWidth;
+        std::cout << failed.size() << " of " << symbols.size() << " symbols differ";
+        if (!failed.empty()) {
+            std::cout << ", diff images in \"" << diff_directory << "\"";
+        }
+        std::cout << std::endl;
+        return failed.empty() ? 0 : 1;
     }
-};
 
-class Symbol {
-    static constexpr double kNameSpacing = 5;
+    if (!tiles.empty()) {
+        double canvas_width, canvas_height;
+        auto placements = packCanvas(symbols, canvas_width, canvas_height);
+        TilePyramid(symbols, placements, canvas_width, canvas_height, tiles, options).write();
+        std::cout << "Wrote Deep Zoom image \"" << tiles << ".dzi\"" << std::endl;
+        return 0;
+    }
 
-    std::vector<Section> sections;
-    std::string name;
-public:
-    Symbol(std::string _name) : name(_name) { }
+    if (filename.empty()) {
+        filename = compile ? "symbols.csym" : kicad ? "symbols.kicad_sym" : (format == SVG) ? "image.svg" : (format == PNG) ? "image.png" : "image.pdf";
+    }
 
-    void addSection(const Section& section) {
-        sections.push_back(section);
+    // "-" writes the PDF to stdout, so status messages go to stderr instead
+    std::ofstream file;
+    if (filename != "-") {
+        file.open(filename, std::ios::binary);
+    }
+    std::ostream& out = (filename == "-") ? std::cout : file;
+    if (!out) {
+        std::cerr << "Could not open \"" << filename << "\"" << std::endl;
+        return 1;
+    }
+    std::ostream& log = (filename == "-") ? std::cerr : std::cout;
+
+    if (compile) {
+        TraceSpan span("write", "io");
+        writeCsym(out, symbols);
+        out.flush();
+        log << "Wrote compiled symbols \"" << filename << "\"" << std::endl;
+        return out ? 0 : 1;
     }
 
-    void draw(Cairo::RefPtr<Cairo::Context> ctx) const {
-        int innerWidth = 0, outerWidth = 0;
-        for (const auto& section: sections) {
-            if (section.minInnerWidth() > innerWidth) {
-                innerWidth = section.minInnerWidth();
-            }
-            if (section.minOuterWidth() > outerWidth) {
-                outerWidth = section.minOuterWidth();
-            }
+    if (kicad) {
+        TraceSpan span("write", "io");
+        KicadWriter writer(out);
+        for (const auto& symbol: symbols) {
+            writer.write(symbol);
         }
+        if (!streamCells([&](Symbol&& cell) { writer.write(cell); })) {
+            return 1;
+        }
+        writer.finish();
+        out.flush();
+        log << "Wrote KiCad symbol library \"" << filename << "\"" << std::endl;
+        return out ? 0 : 1;
+    }
 
-        // Draw symbol name
-        ctx->save();
-        Cairo::TextExtents extents;
-        ctx->get_text_extents(name, extents);
-        ctx->move_to(outerWidth+(innerWidth-extents.width)/2, extents.height);
-        ctx->show_text(name);
-        ctx->restore();
-
-        for (const auto& section: sections) {
-            Cairo::Rectangle r = {
-                .x = outerWidth,
-                .y = extents.height+kNameSpacing,
-                .width = innerWidth,
-                .height = section.height()
-            };
-            section.draw(ctx, r);
+    if (format != PDF) {
+        if (symbols.size() != 1) {
+            std::cerr << "SVG and PNG output hold a single symbol" << std::endl;
+            return 1;
         }
+        auto buffer = renderToBuffer(symbols.front(), format, scale, options);
+        TraceSpan span("write", "io");
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        out.flush();
+        log << "Wrote " << ((format == SVG) ? "SVG" : "PNG") << " file \"" << filename << "\"" << std::endl;
+        return out ? 0 : 1;
     }
-};
 
-int main()
-{
-#ifdef CAIRO_HAS_PDF_SURFACE
-    std::string filename = "image.pdf";
-    int width = 320;
-    int height = 320;
-    auto surface = Cairo::PdfSurface::create(filename, width, height);
+    int width = 320*scale;
+    int height = 320*scale;
+    auto surface = Cairo::PdfSurface::create_for_stream(streamWriter(out), width, height);
     auto cr = Cairo::Context::create(surface);
-    cr->save(); // save the state of the context
-
-    Pin pin1("i_foo", IN, true, "logic [15:0]"),
-        pin2("o_bar", OUT, false, "logic"),
-        pin3("i_foobar", IN, false, "logic"),
-        pin4("i_barfoo", IN, true, "logic [15:0]");
-    Section pins;
-    pins.addPin(pin1);
-    pins.addPin(pin2);
-    pins.addPin(pin3);
-    pins.addPin(pin4);
-    Symbol symbol("My symbol");
-    symbol.addSection(pins);
-    
-    symbol.draw(cr);
-
-    cr->restore();
-    cr->show_page();
-    std::cout << "Wrote PDF file \"" << filename << "\"" << std::endl;
+    SymbolBodyCache bodies;
+
+    if (diagram) {
+        surface->set_size(std::max(1.0, diagram->getWidth()+40)*scale, std::max(1.0, diagram->getHeight()+40)*scale);
+        cr->save();
+        cr->scale(scale, scale);
+        cr->translate(20, 20);
+        diagram->draw(cr, bodies, options);
+        cr->restore();
+        cr->show_page();
+    } else if (!compiled.empty()) {
+        for (const auto& csym: compiled) {
+            for (size_t i = 0; i < csym->symbolCount(); i++) {
+                cr->save();
+                cr->scale(scale, scale);
+                csym->draw(cr, i, options);
+                cr->restore();
+                cr->show_page();
+            }
+        }
+    } else if (pack) {
+        // A4 sheets, in points
+        const double sheet_width = 595, sheet_height = 842;
+        auto placements = packSymbols(symbols, sheet_width, sheet_height);
+        for (size_t first = 0; first < placements.size(); ) {
+            size_t last = first;
+            double page_width = sheet_width, page_height = sheet_height;
+            for (; last < placements.size() && placements[last].sheet == placements[first].sheet; last++) {
+                const auto& symbol = symbols[placements[last].symbol];
+                page_width = std::max(page_width, placements[last].x+symbol.width());
+                page_height = std::max(page_height, placements[last].y+symbol.height());
+            }
+            surface->set_size(page_width*scale, page_height*scale);
+            for (; first < last; first++) {
+                cr->save();
+                cr->scale(scale, scale);
+                cr->translate(placements[first].x, placements[first].y);
+                bodies.draw(cr, symbols[placements[first].symbol], options);
+                cr->restore();
+            }
+            cr->show_page();
+        }
+    } else {
+        auto page = [&](const Symbol& symbol) {
+            cr->save(); // save the state of the context
+            cr->scale(scale, scale);
+            bodies.draw(cr, symbol, options);
+            cr->restore();
+            cr->show_page();
+        };
+        for (const auto& symbol: symbols) {
+            page(symbol);
+        }
+        // The body cache refers to the cells it recorded, so they are kept
+        std::deque<Symbol> cells;
+        if (!streamCells([&](Symbol&& cell) { page(cells.emplace_back(std::move(cell))); })) {
+            return 1;
+        }
+    }
+    {
+        TraceSpan span("finish", "draw");
+        surface->finish();
+    }
+    {
+        TraceSpan span("write", "io");
+        out.flush();
+    }
+    if (!out) {
+        std::cerr << "Could not write \"" << filename << "\"" << std::endl;
+        return 1;
+    }
+    log << "Wrote PDF file \"" << filename << "\"";
+    if (bodies.hitCount() > 0) {
+        log << ", " << bodies.hitCount() << " symbols reused the body of an identical one";
+    }
+    log << std::endl;
     return 0;
 #else
     std::cout << "You must compile cairo with PDF support for this example to work."
@@ -0,0 +1,1289 @@
+#ifndef CAIRO_SYMBOL_H
+#define CAIRO_SYMBOL_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <filesystem>
+#include <limits>
+#include <memory_resource>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cairommconfig.h>
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+#include <cairo-ft.h>
+#include <hb.h>
+#include <hb-ft.h>
+#include <cmath>
+#include "trace.h"
+
+// Shaped text: glyphs positioned relative to the start of the baseline
+struct GlyphRun {
+    const Cairo::Glyph* glyphs;
+    size_t count;
+    Cairo::TextExtents extents;
+};
+
+inline void drawText(Cairo::RefPtr<Cairo::Context> ctx, double x, double y, const GlyphRun& run) {
+    ctx->save();
+    ctx->translate(x, y);
+    cairo_show_glyphs(ctx->cobj(), run.glyphs, run.count);
+    ctx->restore();
+}
+
+inline void drawRTLText(Cairo::RefPtr<Cairo::Context> ctx, double x, double y, const GlyphRun& run) {
+    drawText(ctx, x-run.extents.width, y, run);
+}
+
+// Stand-in for text too small to read: a bar covering the middle of the glyphs
+inline void drawGreekedText(Cairo::RefPtr<Cairo::Context> ctx, double x, double y, const Cairo::TextExtents& extents) {
+    ctx->rectangle(x+extents.x_bearing, y+extents.y_bearing*0.75, extents.width, -extents.y_bearing*0.5);
+    ctx->fill();
+}
+
+// Shared context for text measurements, so they don't each need a new surface
+inline Cairo::RefPtr<Cairo::Context> measureContext() {
+    thread_local auto cr = Cairo::Context::create(Cairo::RecordingSurface::create());
+    return cr;
+}
+
+enum RasterProfile {
+    PRINT,
+    PREVIEW
+};
+
+struct RenderOptions {
+    // Below this many device pixels per user unit, text is drawn as greeked bars
+    double lod_threshold = 0;
+    // Only matters to image surfaces; see applyRasterProfile
+    RasterProfile profile = PRINT;
+};
+
+// PREVIEW draws lines without antialiasing and text with fast antialiasing
+// and hinted metrics, for quick bulk rasterization. PRINT keeps the defaults.
+inline void applyRasterProfile(Cairo::RefPtr<Cairo::Context> ctx, const RenderOptions& options) {
+    if (options.profile == PREVIEW) {
+        ctx->set_antialias(Cairo::ANTIALIAS_NONE);
+        Cairo::FontOptions font_options;
+        font_options.set_antialias(Cairo::ANTIALIAS_FAST);
+        font_options.set_hint_metrics(Cairo::HINT_METRICS_ON);
+        ctx->set_font_options(font_options);
+    }
+}
+
+// Without antialiasing, moves a point of a line of the given width onto the
+// device pixel grid, so the line covers whole pixels and keeps its width
+inline void snapToPixels(Cairo::RefPtr<Cairo::Context> ctx, double& x, double& y, double line_width) {
+    if (ctx->get_antialias() != Cairo::ANTIALIAS_NONE) {
+        return;
+    }
+    double width_x = line_width, width_y = 0;
+    ctx->user_to_device_distance(width_x, width_y);
+    double offset = (std::lround(std::hypot(width_x, width_y))%2) ? 0.5 : 0;
+    ctx->user_to_device(x, y);
+    x = std::round(x-offset)+offset;
+    y = std::round(y-offset)+offset;
+    ctx->device_to_user(x, y);
+}
+
+inline void strokeLine(Cairo::RefPtr<Cairo::Context> ctx, double x1, double y1, double x2, double y2) {
+    snapToPixels(ctx, x1, y1, ctx->get_line_width());
+    snapToPixels(ctx, x2, y2, ctx->get_line_width());
+    ctx->move_to(x1, y1);
+    ctx->line_to(x2, y2);
+    ctx->stroke();
+}
+
+inline void strokeRectangle(Cairo::RefPtr<Cairo::Context> ctx, double x, double y, double width, double height) {
+    double x2 = x+width, y2 = y+height;
+    snapToPixels(ctx, x, y, ctx->get_line_width());
+    snapToPixels(ctx, x2, y2, ctx->get_line_width());
+    ctx->rectangle(x, y, x2-x, y2-y);
+    ctx->stroke();
+}
+
+struct ShapedRun {
+    std::vector<Cairo::Glyph> glyphs;
+    // Pen position after each glyph, the running sum of their advances
+    std::vector<double> advances;
+    Cairo::TextExtents extents;
+
+    GlyphRun view() const {
+        return { glyphs.data(), glyphs.size(), extents };
+    }
+};
+
+// Shapes labels with HarfBuzz, once per (font, string) for as long as
+// anything holds on to the run. The caches only keep weak references, so the
+// labels of a library that is gone are freed with it; their entries are swept
+// out whenever a cache has doubled in size since the last sweep.
+class TextShaper {
+    // HarfBuzz positions are in 1/kScale of a user unit
+    static constexpr int kScale = 64;
+    static constexpr size_t kMinSweep = 1024;
+
+    struct Font {
+        cairo_font_face_t* face = nullptr;
+        hb_font_t* font = nullptr;
+        std::unordered_map<std::string, std::weak_ptr<const ShapedRun>> runs;
+        // Keyed by the text and the width it was cut to
+        std::map<std::pair<std::string, double>, std::weak_ptr<const ShapedRun>> truncated;
+        size_t runs_sweep = kMinSweep, truncated_sweep = kMinSweep;
+        std::shared_ptr<const ShapedRun> ellipsis;
+    };
+
+    std::mutex mutex;
+    std::map<std::pair<cairo_font_face_t*, double>, Font> fonts;
+
+    TextShaper() { }
+
+    template <typename Cache>
+    static void sweep(Cache& cache, size_t& sweep_at) {
+        if (cache.size() < sweep_at) {
+            return;
+        }
+        for (auto it = cache.begin(); it != cache.end(); ) {
+            it = it->second.expired() ? cache.erase(it) : std::next(it);
+        }
+        sweep_at = std::max(kMinSweep, 2*cache.size());
+    }
+
+    static hb_font_t* createFont(cairo_scaled_font_t* scaled_font, double size) {
+        // Only FreeType fonts can be handed to HarfBuzz
+        if (cairo_scaled_font_get_type(scaled_font) != CAIRO_FONT_TYPE_FT) {
+            return nullptr;
+        }
+        FT_Face ft_face = cairo_ft_scaled_font_lock_face(scaled_font);
+        if (!ft_face) {
+            return nullptr;
+        }
+        hb_face_t* face = hb_ft_face_create_referenced(ft_face);
+        cairo_ft_scaled_font_unlock_face(scaled_font);
+        hb_font_t* font = hb_font_create(face);
+        hb_face_destroy(face);
+        hb_font_set_scale(font, size*kScale, size*kScale);
+        return font;
+    }
+
+    static void shapeRun(hb_font_t* font, cairo_scaled_font_t* scaled_font, std::string_view text, ShapedRun& run) {
+        if (!font) {
+            // Plain cairo glyph lookup, without kerning
+            cairo_glyph_t* glyphs = nullptr;
+            int count = 0;
+            if (cairo_scaled_font_text_to_glyphs(scaled_font, 0, 0, text.data(), text.size(), &glyphs, &count,
+                                                 nullptr, nullptr, nullptr) == CAIRO_STATUS_SUCCESS) {
+                run.glyphs.assign(glyphs, glyphs+count);
+            }
+            cairo_glyph_free(glyphs);
+            for (size_t i = 1; i < run.glyphs.size(); i++) {
+                run.advances.push_back(run.glyphs[i].x);
+            }
+            if (!run.glyphs.empty()) {
+                cairo_text_extents_t last;
+                cairo_scaled_font_glyph_extents(scaled_font, &run.glyphs.back(), 1, &last);
+                run.advances.push_back(run.glyphs.back().x+last.x_advance);
+            }
+            return;
+        }
+
+        hb_buffer_t* buffer = hb_buffer_create();
+        hb_buffer_add_utf8(buffer, text.data(), text.size(), 0, text.size());
+        hb_buffer_guess_segment_properties(buffer);
+        hb_shape(font, buffer, nullptr, 0);
+        unsigned count;
+        hb_glyph_info_t* infos = hb_buffer_get_glyph_infos(buffer, &count);
+        hb_glyph_position_t* positions = hb_buffer_get_glyph_positions(buffer, &count);
+        double x = 0, y = 0;
+        for (unsigned i = 0; i < count; i++) {
+            run.glyphs.push_back({ infos[i].codepoint,
+                                   x+double(positions[i].x_offset)/kScale,
+                                   y-double(positions[i].y_offset)/kScale });
+            x += double(positions[i].x_advance)/kScale;
+            y -= double(positions[i].y_advance)/kScale;
+            run.advances.push_back(x);
+        }
+        hb_buffer_destroy(buffer);
+    }
+
+    // Entry for ctx's current font; the mutex must be held
+    Font& fontOf(Cairo::RefPtr<Cairo::Context> ctx) {
+        auto scaled_font = ctx->get_scaled_font();
+        cairo_matrix_t font_matrix;
+        cairo_get_font_matrix(ctx->cobj(), &font_matrix);
+        cairo_font_face_t* face = cairo_scaled_font_get_font_face(scaled_font->cobj());
+        Font& font = fonts[{ face, font_matrix.yy }];
+        if (!font.face) {
+            font.face = cairo_font_face_reference(face);
+            font.font = createFont(scaled_font->cobj(), font_matrix.yy);
+        }
+        return font;
+    }
+
+    std::shared_ptr<const ShapedRun> shapeLocked(Cairo::RefPtr<Cairo::Context> ctx, Font& font, std::string_view text) {
+        std::weak_ptr<const ShapedRun>& entry = font.runs[std::string(text)];
+        std::shared_ptr<const ShapedRun> cached = entry.lock();
+        if (cached) {
+            return cached;
+        }
+        TraceSpan span("shape", "layout", true);
+        auto run = std::make_shared<ShapedRun>();
+        shapeRun(font.font, ctx->get_scaled_font()->cobj(), text, *run);
+        ctx->get_glyph_extents(run->glyphs, run->extents);
+        entry = run;
+        sweep(font.runs, font.runs_sweep);
+        return run;
+    }
+public:
+    ~TextShaper() {
+        for (auto& font: fonts) {
+            if (font.second.font) {
+                hb_font_destroy(font.second.font);
+            }
+            cairo_font_face_destroy(font.second.face);
+        }
+    }
+
+    static TextShaper& instance() {
+        static TextShaper shaper;
+        return shaper;
+    }
+
+    // Glyph run of text in ctx's current font
+    std::shared_ptr<const ShapedRun> shape(Cairo::RefPtr<Cairo::Context> ctx, std::string_view text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return shapeLocked(ctx, fontOf(ctx), text);
+    }
+
+    // Glyph run of text cut short with an ellipsis to fit max_width, or the
+    // whole run if it fits. The cut is found by a binary search over the
+    // advances of the whole run, which is shaped only once.
+    std::shared_ptr<const ShapedRun> truncate(Cairo::RefPtr<Cairo::Context> ctx, std::string_view text, double max_width) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Font& font = fontOf(ctx);
+        std::shared_ptr<const ShapedRun> full = shapeLocked(ctx, font, text);
+        if (full->extents.width <= max_width) {
+            return full;
+        }
+        std::weak_ptr<const ShapedRun>& entry = font.truncated[{ std::string(text), max_width }];
+        std::shared_ptr<const ShapedRun> cached = entry.lock();
+        if (cached) {
+            return cached;
+        }
+        if (!font.ellipsis) {
+            font.ellipsis = shapeLocked(ctx, font, "\u2026");
+        }
+        const ShapedRun& ellipsis = *font.ellipsis;
+        double ellipsis_width = ellipsis.advances.empty() ? 0 : ellipsis.advances.back();
+        size_t count = std::upper_bound(full->advances.begin(), full->advances.end(), max_width-ellipsis_width)-full->advances.begin();
+        double x = (count > 0) ? full->advances[count-1] : 0;
+
+        auto run = std::make_shared<ShapedRun>();
+        run->glyphs.assign(full->glyphs.begin(), full->glyphs.begin()+count);
+        run->advances.assign(full->advances.begin(), full->advances.begin()+count);
+        for (size_t i = 0; i < ellipsis.glyphs.size(); i++) {
+            Cairo::Glyph glyph = ellipsis.glyphs[i];
+            glyph.x += x;
+            run->glyphs.push_back(glyph);
+            run->advances.push_back(x+ellipsis.advances[i]);
+        }
+        ctx->get_glyph_extents(run->glyphs, run->extents);
+        entry = run;
+        sweep(font.truncated, font.truncated_sweep);
+        return run;
+    }
+};
+
+inline bool isGreeked(Cairo::RefPtr<Cairo::Context> ctx, const RenderOptions& options) {
+    double pixel_x = 1, pixel_y = 0;
+    ctx->user_to_device_distance(pixel_x, pixel_y);
+    return std::hypot(pixel_x, pixel_y) < options.lod_threshold;
+}
+
+enum PinDirection {
+    IN,
+    OUT,
+    INOUT
+};
+
+class Pin {
+    static constexpr double kStemLength = 15;
+    static constexpr double kWireStemWidth = 1;
+    static constexpr double kBusStemWidth = 2;
+    static constexpr double kTextPadding = 5;
+
+    PinDirection direction;
+    std::pmr::string name;
+    std::pmr::string type;
+    bool is_bus;
+
+    double max_name_width = 0;
+
+    // Shared with every other label of the same text
+    mutable std::shared_ptr<const ShapedRun> name_run;
+    mutable std::shared_ptr<const ShapedRun> type_run;
+
+    void measure() const {
+        if (!name_run) {
+            auto cr = measureContext();
+            type_run = TextShaper::instance().shape(cr, type);
+            name_run = (max_name_width > 0) ? TextShaper::instance().truncate(cr, name, max_name_width)
+                                            : TextShaper::instance().shape(cr, name);
+        }
+    }
+public:
+    // Strings live in the allocator's memory resource, see SymbolLibrary
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    Pin(std::string_view _name, PinDirection _direction, bool _is_bus = false, std::string_view _type = "cc") :
+        Pin(std::allocator_arg, allocator_type(), _name, _direction, _is_bus, _type) { }
+
+    Pin(std::allocator_arg_t, const allocator_type& alloc, std::string_view _name, PinDirection _direction,
+        bool _is_bus = false, std::string_view _type = "cc") :
+        direction(_direction), name(_name, alloc), type(_type, alloc), is_bus(_is_bus) { }
+
+    Pin(std::allocator_arg_t, const allocator_type& alloc, const Pin& other) :
+        direction(other.direction), name(other.name, alloc), type(other.type, alloc), is_bus(other.is_bus),
+        max_name_width(other.max_name_width), name_run(other.name_run), type_run(other.type_run) { }
+
+    Pin(std::allocator_arg_t, const allocator_type& alloc, Pin&& other) :
+        direction(other.direction), name(std::move(other.name), alloc), type(std::move(other.type), alloc), is_bus(other.is_bus),
+        max_name_width(other.max_name_width), name_run(other.name_run), type_run(other.type_run) { }
+
+    Pin(const Pin&) = default;
+    Pin(Pin&&) = default;
+    Pin& operator=(const Pin&) = default;
+    Pin& operator=(Pin&&) = default;
+
+    // Draws a pin from already shaped text, as cached by Pin or stored in a .csym file
+    static void drawMeasured(Cairo::RefPtr<Cairo::Context> ctx, const Cairo::Rectangle& pos, PinDirection direction, bool is_bus,
+                             const GlyphRun& name, const GlyphRun& type, bool greeked = false) {
+        ctx->save();
+
+        // Draw pin name
+        ctx->save();
+        if (greeked) {
+            double x = (direction == IN) ? pos.x+kTextPadding : pos.x-kTextPadding-name.extents.width;
+            drawGreekedText(ctx, x, pos.y, name.extents);
+        } else if (direction == IN) {
+            drawText(ctx, pos.x+kTextPadding, pos.y, name);
+        } else {
+            drawRTLText(ctx, pos.x-kTextPadding, pos.y, name);
+        }
+        ctx->restore();
+
+        // Draw pin stem
+        ctx->save();
+        ctx->set_line_width((is_bus) ? kBusStemWidth : kWireStemWidth);
+        double stem_y = pos.y+name.extents.y_bearing/2;
+        strokeLine(ctx, pos.x, stem_y, (direction == IN) ? pos.x-kStemLength : pos.x+kStemLength, stem_y);
+        ctx->restore();
+
+        // Draw pin type
+        ctx->save();
+        ctx->set_source_rgb(0.5, 0.5, 0.5);
+        if (greeked) {
+            double x = (direction == IN) ? pos.x-kTextPadding-kStemLength-type.extents.width : pos.x+kTextPadding+kStemLength;
+            drawGreekedText(ctx, x, pos.y, type.extents);
+        } else if (direction == IN) {
+            drawRTLText(ctx, pos.x-kTextPadding-kStemLength, pos.y, type);
+        } else {
+            drawText(ctx, pos.x+kTextPadding+kStemLength, pos.y, type);
+        }
+        ctx->restore();
+
+        ctx->restore();
+    }
+
+    // Outer end of the stem of a pin drawn at pos, where a wire attaches
+    static void stemEnd(const Cairo::Rectangle& pos, PinDirection direction, const Cairo::TextExtents& name, double& x, double& y) {
+        x = (direction == IN) ? pos.x-kStemLength : pos.x+kStemLength;
+        y = pos.y+name.y_bearing/2;
+    }
+
+    // Box covering the type, stem and name of a pin drawn at pos
+    static Cairo::Rectangle bounds(const Cairo::Rectangle& pos, PinDirection direction,
+                                   const Cairo::TextExtents& name, const Cairo::TextExtents& type) {
+        double inner = kTextPadding+name.width, outer = kStemLength+kTextPadding+type.width;
+        double top = std::min(name.y_bearing, type.y_bearing);
+        double bottom = std::max(name.y_bearing+name.height, type.y_bearing+type.height);
+        return { (direction == IN) ? pos.x-outer : pos.x-inner, pos.y+top, inner+outer, bottom-top };
+    }
+
+    void draw(Cairo::RefPtr<Cairo::Context> ctx, const Cairo::Rectangle& pos, bool greeked = false) const {
+        TraceSpan span("pin", "draw", true);
+        measure();
+        drawMeasured(ctx, pos, direction, is_bus, name_run->view(), type_run->view(), greeked);
+    }
+
+    // The whole name, even when nameRun() is truncated
+    std::string_view getName() const {
+        return name;
+    }
+
+    // Renaming drops the shaped text, so the pin is re-measured on next use
+    void setName(std::string_view _name) {
+        name = _name;
+        name_run = nullptr;
+    }
+
+    // Names wider than this are drawn cut short with an ellipsis, 0 for no
+    // limit; getName() still returns the whole name. A new limit drops the
+    // shaped name, as renaming does.
+    void setMaxNameWidth(double width) {
+        if (width != max_name_width) {
+            max_name_width = width;
+            name_run = nullptr;
+        }
+    }
+
+    double getMaxNameWidth() const {
+        return max_name_width;
+    }
+
+    std::string_view getType() const {
+        return type;
+    }
+
+    bool isBus() const {
+        return is_bus;
+    }
+
+    GlyphRun nameRun() const {
+        measure();
+        return name_run->view();
+    }
+
+    GlyphRun typeRun() const {
+        measure();
+        return type_run->view();
+    }
+
+    PinDirection getDirection() const {
+        return direction;
+    }
+
+    bool operator==(const Pin& other) const {
+        return direction == other.direction && is_bus == other.is_bus && name == other.name && type == other.type &&
+               max_name_width == other.max_name_width;
+    }
+
+    size_t hash() const {
+        size_t hash = std::hash<std::string_view>()(name);
+        hash = hash*31+std::hash<std::string_view>()(type);
+        return hash*31+direction*2+is_bus;
+    }
+
+    int innerWidth() const {
+        measure();
+        return kTextPadding+name_run->extents.width;
+    }
+
+    int outerWidth() const {
+        measure();
+        return kStemLength+kTextPadding+type_run->extents.width;
+    }
+
+    static int height() {
+        static const int h = [] {
+            Cairo::TextExtents extents;
+            measureContext()->get_text_extents("Hello world", extents);
+            return (int)extents.height;
+        }();
+        return h;
+    }
+};
+
+class Section {
+    static constexpr double kTextSeparator = 10;
+    static constexpr double kTopBottomPadding = 10;
+    static constexpr double kBorderThickness = 1.5;
+    static constexpr double kPinSpacing = 5;
+
+    std::pmr::vector<Pin> pins;
+    std::pmr::string name;
+    double max_name_width = 0;
+
+    int rows() const {
+        int left_rows = 0, right_rows = 0;
+        for (const auto& pin : pins) {
+            if (pin.getDirection() == IN) {
+                left_rows += 1;
+            } else {
+                right_rows += 1;
+            }
+        }
+        return (left_rows > right_rows) ? left_rows : right_rows;
+    }
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    Section(std::string_view _name = "") : Section(std::allocator_arg, allocator_type(), _name) {
+
+    }
+
+    Section(std::allocator_arg_t, const allocator_type& alloc, std::string_view _name = "") :
+        pins(alloc), name(_name, alloc) { }
+
+    Section(std::allocator_arg_t, const allocator_type& alloc, const Section& other) :
+        pins(other.pins, alloc), name(other.name, alloc), max_name_width(other.max_name_width) { }
+
+    Section(std::allocator_arg_t, const allocator_type& alloc, Section&& other) :
+        pins(std::move(other.pins), alloc), name(std::move(other.name), alloc), max_name_width(other.max_name_width) { }
+
+    Section(const Section&) = default;
+    Section(Section&&) = default;
+    Section& operator=(const Section&) = default;
+    Section& operator=(Section&&) = default;
+
+    void addPin(const Pin& pin) {
+        pins.push_back(pin);
+        pins.back().setMaxNameWidth(max_name_width);
+    }
+
+    // Constructs the pin in place, in this section's memory resource
+    template <typename... Args>
+    Pin& emplacePin(Args&&... args) {
+        Pin& pin = pins.emplace_back(std::forward<Args>(args)...);
+        pin.setMaxNameWidth(max_name_width);
+        return pin;
+    }
+
+    // See Pin::setMaxNameWidth; also applies to pins added later
+    void setMaxNameWidth(double width) {
+        max_name_width = width;
+        for (auto& pin: pins) {
+            pin.setMaxNameWidth(width);
+        }
+    }
+
+    void reservePins(size_t count) {
+        pins.reserve(count);
+    }
+
+    // Calls fn(pin, pin_rect) with the position draw() gives each pin inside pos
+    template <typename Fn>
+    void forEachPin(const Cairo::Rectangle& pos, Fn fn) const {
+        // Inputs go down the left edge, everything else down the right edge
+        Cairo::Rectangle pin_rect = {
+            .x = pos.x,
+            .y = pos.y+kTopBottomPadding
+        };
+        for (const auto& pin: pins) {
+            if (pin.getDirection() == IN) {
+                pin_rect.y += pin.height();
+                fn(pin, pin_rect);
+                pin_rect.y += kPinSpacing;
+            }
+        }
+        pin_rect.x = pos.x+pos.width;
+        pin_rect.y = pos.y+kTopBottomPadding;
+        for (const auto& pin: pins) {
+            if (pin.getDirection() != IN) {
+                pin_rect.y += pin.height();
+                fn(pin, pin_rect);
+                pin_rect.y += kPinSpacing;
+            }
+        }
+    }
+
+    void draw(Cairo::RefPtr<Cairo::Context> ctx, const Cairo::Rectangle& pos, bool greeked = false) const {
+        TraceSpan span("section", "draw");
+        ctx->save();
+
+        // Draw section rectangle
+        strokeRectangle(ctx, pos.x, pos.y, pos.width, pos.height);
+
+        forEachPin(pos, [&](const Pin& pin, const Cairo::Rectangle& pin_rect) {
+            pin.draw(ctx, pin_rect, greeked);
+        });
+
+        ctx->restore();
+    }
+
+    std::string_view getName() const {
+        return name;
+    }
+
+    size_t pinCount() const {
+        return pins.size();
+    }
+
+    Pin& getPin(size_t index) {
+        return pins[index];
+    }
+
+    const Pin& getPin(size_t index) const {
+        return pins[index];
+    }
+
+    bool operator==(const Section& other) const {
+        return name == other.name && pins == other.pins;
+    }
+
+    size_t hash() const {
+        size_t hash = std::hash<std::string_view>()(name);
+        for (const auto& pin: pins) {
+            hash = hash*31+pin.hash();
+        }
+        return hash;
+    }
+
+    int height() const {
+        return kPinSpacing*(rows()-1)+rows()*Pin::height()+2*kTopBottomPadding;
+    }
+
+    int minInnerWidth() const {
+        int leftInnerWidth = 0, rightInnerWidth = 0;
+        for (const auto& pin : pins) {
+            if (pin.innerWidth() > leftInnerWidth && pin.getDirection() == IN) {
+                leftInnerWidth = pin.innerWidth();
+            } else if (pin.innerWidth() > rightInnerWidth && pin.getDirection() != IN) {
+                rightInnerWidth = pin.innerWidth();
+            }
+        }
+        return leftInnerWidth+kTextSeparator+rightInnerWidth;
+    }
+
+    int minOuterWidth() const {
+        int minOuterWidth = 0;
+        for (const auto& pin : pins) {
+            if (pin.outerWidth() > minOuterWidth) {
+                minOuterWidth = pin.outerWidth();
+            }
+        }
+        return minOuterWidth;
+    }
+};
+
+class Symbol {
+    static constexpr double kNameSpacing = 5;
+
+    std::pmr::vector<Section> sections;
+    std::pmr::string name;
+    double max_name_width = 0;
+
+    mutable std::shared_ptr<const ShapedRun> name_run;
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    Symbol(std::string_view _name) : Symbol(std::allocator_arg, allocator_type(), _name) { }
+
+    Symbol(std::allocator_arg_t, const allocator_type& alloc, std::string_view _name) :
+        sections(alloc), name(_name, alloc) { }
+
+    Section& addSection(const Section& section) {
+        sections.push_back(section);
+        sections.back().setMaxNameWidth(max_name_width);
+        return sections.back();
+    }
+
+    // Constructs the section in place, in this symbol's memory resource
+    template <typename... Args>
+    Section& emplaceSection(Args&&... args) {
+        Section& section = sections.emplace_back(std::forward<Args>(args)...);
+        section.setMaxNameWidth(max_name_width);
+        return section;
+    }
+
+    // Limit on the width of pin names, see Pin::setMaxNameWidth; also
+    // applies to sections added later
+    void setMaxNameWidth(double width) {
+        max_name_width = width;
+        for (auto& section: sections) {
+            section.setMaxNameWidth(width);
+        }
+    }
+
+    size_t sectionCount() const {
+        return sections.size();
+    }
+
+    Section& getSection(size_t index) {
+        return sections[index];
+    }
+
+    const Section& getSection(size_t index) const {
+        return sections[index];
+    }
+
+    int innerWidth() const {
+        int innerWidth = 0;
+        for (const auto& section: sections) {
+            innerWidth = std::max(innerWidth, section.minInnerWidth());
+        }
+        return innerWidth;
+    }
+
+    int outerWidth() const {
+        int outerWidth = 0;
+        for (const auto& section: sections) {
+            outerWidth = std::max(outerWidth, section.minOuterWidth());
+        }
+        return outerWidth;
+    }
+
+    // Box around all sections, between the pin stems and below the name. It
+    // is moved right when the name, centered on it, is wider than the stems
+    // and frame together, so nothing draw() paints starts left of x = 0.
+    Cairo::Rectangle frame() const {
+        Cairo::Rectangle frame = {
+            .x = std::max((double)outerWidth(), (nameExtents().width-innerWidth())/2),
+            .y = bodyTop(),
+            .width = (double)innerWidth(),
+            .height = 0
+        };
+        for (const auto& section: sections) {
+            frame.height += section.height();
+        }
+        return frame;
+    }
+
+    // Bounding box of everything draw() paints, with the origin at (0, 0)
+    double width() const {
+        Cairo::Rectangle frame = this->frame();
+        return 2*frame.x+frame.width;
+    }
+
+    double height() const {
+        Cairo::Rectangle frame = this->frame();
+        return frame.y+frame.height;
+    }
+
+    std::string_view getName() const {
+        return name;
+    }
+
+    GlyphRun nameRun() const {
+        if (!name_run) {
+            name_run = TextShaper::instance().shape(measureContext(), name);
+        }
+        return name_run->view();
+    }
+
+    const Cairo::TextExtents& nameExtents() const {
+        nameRun();
+        return name_run->extents;
+    }
+
+    double bodyTop() const {
+        return nameExtents().height+kNameSpacing;
+    }
+
+    // Symbols with the same structure differ only in their name
+    bool sameStructure(const Symbol& other) const {
+        return sections == other.sections;
+    }
+
+    size_t structureHash() const {
+        size_t hash = sections.size();
+        for (const auto& section: sections) {
+            hash = hash*31+section.hash();
+        }
+        return hash;
+    }
+
+    // Baseline origin of the symbol name, centered above the frame
+    void namePosition(const Cairo::Rectangle& frame, double& x, double& y) const {
+        x = frame.x+(frame.width-nameExtents().width)/2;
+        y = nameExtents().height;
+    }
+
+    // Calls fn(section, section_rect) for each section as stacked inside frame
+    template <typename Fn>
+    void forEachSection(const Cairo::Rectangle& frame, Fn fn) const {
+        // Sections are stacked below the name, sharing their horizontal edges
+        double y = frame.y;
+        for (const auto& section: sections) {
+            Cairo::Rectangle r = {
+                .x = frame.x,
+                .y = y,
+                .width = frame.width,
+                .height = (double)section.height()
+            };
+            fn(section, r);
+            y += r.height;
+        }
+    }
+
+    void drawName(Cairo::RefPtr<Cairo::Context> ctx, const Cairo::Rectangle& frame, bool greeked = false) const {
+        ctx->save();
+        double name_x, name_y;
+        namePosition(frame, name_x, name_y);
+        if (greeked) {
+            drawGreekedText(ctx, name_x, name_y, nameExtents());
+        } else {
+            drawText(ctx, name_x, name_y, nameRun());
+        }
+        ctx->restore();
+    }
+
+    // Everything but the name: the sections and their pins
+    void drawBody(Cairo::RefPtr<Cairo::Context> ctx, const Cairo::Rectangle& frame, bool greeked = false) const {
+        forEachSection(frame, [&](const Section& section, const Cairo::Rectangle& r) {
+            section.draw(ctx, r, greeked);
+        });
+    }
+
+    void draw(Cairo::RefPtr<Cairo::Context> ctx, const RenderOptions& options = RenderOptions()) const {
+        bool greeked = isGreeked(ctx, options);
+        Cairo::Rectangle frame = this->frame();
+        drawName(ctx, frame, greeked);
+        drawBody(ctx, frame, greeked);
+    }
+};
+
+// For batch rendering: symbols that differ only in their name share one
+// recorded drawing of their body, which is laid out and drawn once and then
+// replayed under each variant's name. Symbols must outlive the cache.
+class SymbolBodyCache {
+    struct Body {
+        const Symbol* symbol;
+        bool greeked;
+        Cairo::Rectangle frame;
+        Cairo::RefPtr<Cairo::RecordingSurface> recording;
+    };
+
+    std::unordered_multimap<size_t, Body> bodies;
+    size_t hits = 0;
+public:
+    void draw(Cairo::RefPtr<Cairo::Context> ctx, const Symbol& symbol, const RenderOptions& options = RenderOptions()) {
+        bool greeked = isGreeked(ctx, options);
+        size_t hash = symbol.structureHash();
+        const Body* body = nullptr;
+        auto range = bodies.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.greeked == greeked && it->second.symbol->sameStructure(symbol)) {
+                body = &it->second;
+                hits++;
+                break;
+            }
+        }
+        if (!body) {
+            // Recorded with the frame at y = 0, as the name height varies
+            Cairo::Rectangle frame = symbol.frame();
+            frame.y = 0;
+            auto recording = Cairo::RecordingSurface::create();
+            symbol.drawBody(Cairo::Context::create(recording), frame, greeked);
+            body = &bodies.emplace(hash, Body { &symbol, greeked, frame, recording })->second;
+        }
+
+        // The frame moves right under names wider than the body
+        Cairo::Rectangle frame = symbol.frame();
+        symbol.drawName(ctx, frame, greeked);
+        ctx->save();
+        ctx->set_source(body->recording, frame.x-body->frame.x, frame.y);
+        ctx->paint();
+        ctx->restore();
+    }
+
+    // Number of symbols drawn from an already recorded body
+    size_t hitCount() const {
+        return hits;
+    }
+};
+
+// Owns a set of symbols along with all of their sections, pins and strings,
+// which are carved out of one monotonic arena and released together
+class SymbolLibrary {
+    std::pmr::monotonic_buffer_resource arena;
+    std::vector<Symbol> symbols;
+    double max_name_width = 0;
+public:
+    explicit SymbolLibrary(size_t initial_size = 1 << 16) : arena(initial_size) { }
+
+    SymbolLibrary(const SymbolLibrary&) = delete;
+    SymbolLibrary& operator=(const SymbolLibrary&) = delete;
+
+    Symbol& emplaceSymbol(std::string_view name) {
+        Symbol& symbol = symbols.emplace_back(std::allocator_arg, &arena, name);
+        symbol.setMaxNameWidth(max_name_width);
+        return symbol;
+    }
+
+    // Takes over a symbol built elsewhere, which keeps its own allocator
+    Symbol& addSymbol(Symbol&& symbol) {
+        Symbol& added = symbols.emplace_back(std::move(symbol));
+        added.setMaxNameWidth(max_name_width);
+        return added;
+    }
+
+    // Limit on the width of pin names in every symbol, including those
+    // added later; see Pin::setMaxNameWidth
+    void setMaxNameWidth(double width) {
+        max_name_width = width;
+        for (auto& symbol: symbols) {
+            symbol.setMaxNameWidth(width);
+        }
+    }
+
+    void reserve(size_t count) {
+        symbols.reserve(count);
+    }
+
+    const std::vector<Symbol>& getSymbols() const {
+        return symbols;
+    }
+};
+
+// Skyline bottom-left packer: the free space of a sheet is tracked as the
+// upper outline of everything placed so far, and each rectangle goes to the
+// lowest position along that outline where it fits.
+class SkylinePacker {
+    struct Segment {
+        double x, y, width;
+    };
+
+    double width, height;
+    std::vector<Segment> skyline;
+
+    // Lowest y at which a rectangle of the given width fits, starting at segment i
+    double fitAt(size_t i, double w) const {
+        double right = skyline[i].x+w, y = 0;
+        for (size_t j = i; j < skyline.size() && skyline[j].x < right; j++) {
+            y = std::max(y, skyline[j].y);
+        }
+        return y;
+    }
+public:
+    SkylinePacker(double _width, double _height) : width(_width), height(_height) {
+        skyline.push_back({0, 0, width});
+    }
+
+    bool insert(double w, double h, Cairo::Rectangle& placed) {
+        size_t best = skyline.size();
+        double best_y = height;
+        for (size_t i = 0; i < skyline.size(); i++) {
+            if (skyline[i].x+w > width) {
+                break;
+            }
+            double y = fitAt(i, w);
+            if (y+h <= height && y < best_y) {
+                best = i;
+                best_y = y;
+            }
+        }
+        if (best == skyline.size()) {
+            return false;
+        }
+        placed = { skyline[best].x, best_y, w, h };
+
+        // Raise the outline under the new rectangle, trimming what it covers
+        Segment raised = { placed.x, best_y+h, w };
+        size_t end = best;
+        while (end < skyline.size() && skyline[end].x+skyline[end].width <= placed.x+w) {
+            end++;
+        }
+        if (end < skyline.size() && skyline[end].x < placed.x+w) {
+            double shrink = placed.x+w-skyline[end].x;
+            skyline[end].x += shrink;
+            skyline[end].width -= shrink;
+        }
+        skyline.erase(skyline.begin()+best, skyline.begin()+end);
+        skyline.insert(skyline.begin()+best, raised);
+
+        // Merge neighbours left at the same height
+        for (size_t i = (best > 0) ? best-1 : 0; i+1 < skyline.size() && i <= best+1; ) {
+            if (skyline[i].y == skyline[i+1].y) {
+                skyline[i].width += skyline[i+1].width;
+                skyline.erase(skyline.begin()+i+1);
+            } else {
+                i++;
+            }
+        }
+        return true;
+    }
+};
+
+struct Placement {
+    size_t symbol;
+    int sheet;
+    double x, y;
+};
+
+// Places every symbol on a sheet of the given size, tallest first. Symbols
+// larger than a sheet get one to themselves.
+inline std::vector<Placement> packSymbols(const std::vector<Symbol>& symbols, double sheet_width, double sheet_height) {
+    static constexpr double kSymbolMargin = 10;
+
+    std::vector<size_t> order(symbols.size());
+    std::vector<Cairo::Rectangle> boxes(symbols.size());
+    for (size_t i = 0; i < symbols.size(); i++) {
+        order[i] = i;
+        boxes[i] = { 0, 0, symbols[i].width()+kSymbolMargin, symbols[i].height()+kSymbolMargin };
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return boxes[a].height > boxes[b].height;
+    });
+
+    std::vector<Placement> placements;
+    SkylinePacker sheet(sheet_width, sheet_height);
+    int sheet_index = 0;
+    bool sheet_empty = true;
+    for (size_t i : order) {
+        Cairo::Rectangle placed;
+        if (!sheet.insert(boxes[i].width, boxes[i].height, placed)) {
+            if (!sheet_empty) {
+                sheet = SkylinePacker(sheet_width, sheet_height);
+                sheet_index++;
+            }
+            if (!sheet.insert(boxes[i].width, boxes[i].height, placed)) {
+                // Too big for a sheet, so nothing else may share this one
+                placed = { 0, 0, boxes[i].width, boxes[i].height };
+                sheet = SkylinePacker(sheet_width, 0);
+            }
+        }
+        sheet_empty = false;
+        placements.push_back({ i, sheet_index, placed.x+kSymbolMargin/2, placed.y+kSymbolMargin/2 });
+    }
+    return placements;
+}
+
+// Write function for cairo's *_stream variants, appending to any std::ostream
+inline Cairo::Surface::SlotWriteFunc streamWriter(std::ostream& out) {
+    return [&out](const unsigned char* data, unsigned int length) {
+        out.write(reinterpret_cast<const char*>(data), length);
+        return out ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+    };
+}
+
+enum OutputFormat {
+    PDF,
+    SVG,
+    PNG
+};
+
+// Blank border renderToBuffer() leaves around the symbol, in points
+static constexpr double kPageMargin = 2;
+
+// Renders one symbol on a page fitted to its bounding box and returns the
+// encoded file contents. The symbol's (x, y) lands on page point
+// ((x+kPageMargin)*scale, (y+kPageMargin)*scale).
+inline std::vector<unsigned char> renderToBuffer(const Symbol& symbol, OutputFormat format, double scale = 1,
+                                                 const RenderOptions& options = RenderOptions()) {
+    std::vector<unsigned char> buffer;
+    auto append = [&buffer](const unsigned char* data, unsigned int length) {
+        buffer.insert(buffer.end(), data, data+length);
+        return CAIRO_STATUS_SUCCESS;
+    };
+
+    double width = std::ceil((symbol.width()+2*kPageMargin)*scale);
+    double height = std::ceil((symbol.height()+2*kPageMargin)*scale);
+    Cairo::RefPtr<Cairo::Surface> surface;
+    switch (format) {
+#ifdef CAIRO_HAS_PDF_SURFACE
+    case PDF:
+        surface = Cairo::PdfSurface::create_for_stream(append, width, height);
+        break;
+#endif
+#ifdef CAIRO_HAS_SVG_SURFACE
+    case SVG:
+        surface = Cairo::SvgSurface::create_for_stream(append, width, height);
+        break;
+#endif
+    case PNG:
+        surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, std::max(1.0, width), std::max(1.0, height));
+        break;
+    default:
+        return buffer;
+    }
+
+    auto cr = Cairo::Context::create(surface);
+    applyRasterProfile(cr, options);
+    cr->scale(scale, scale);
+    cr->translate(kPageMargin, kPageMargin);
+    symbol.draw(cr, options);
+    cr->show_page();
+    if (format == PNG) {
+        TraceSpan span("write", "io");
+        surface->write_to_png_stream(append);
+    }
+    TraceSpan span("finish", "draw");
+    surface->finish();
+    return buffer;
+}
+
+// Packs all symbols onto one roughly square canvas and returns its size
+inline std::vector<Placement> packCanvas(const std::vector<Symbol>& symbols, double& width, double& height) {
+    double area = 0, widest = 0;
+    for (const auto& symbol: symbols) {
+        area += symbol.width()*symbol.height();
+        widest = std::max(widest, symbol.width());
+    }
+    auto placements = packSymbols(symbols, std::max(std::sqrt(area)*1.2, widest+20), std::numeric_limits<double>::max());
+    width = height = 0;
+    for (const auto& placement: placements) {
+        width = std::max(width, placement.x+symbols[placement.symbol].width());
+        height = std::max(height, placement.y+symbols[placement.symbol].height());
+    }
+    return placements;
+}
+
+// Calls fn for 0..count-1 spread over one thread per core. If fn throws, the
+// remaining indices are skipped and the first exception is rethrown here.
+inline void parallelFor(int count, const std::function<void(int)>& fn) {
+    std::atomic<int> next(0);
+    std::mutex mutex;
+    std::exception_ptr error;
+    std::vector<std::thread> workers;
+    for (unsigned n = 0; n < std::max(1u, std::thread::hardware_concurrency()); n++) {
+        workers.emplace_back([&] {
+            try {
+                for (int i = next++; i < count; i = next++) {
+                    fn(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        });
+    }
+    for (auto& worker: workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Deep Zoom image of symbols placed on a canvas: <name>.dzi plus
+// <name>_files/<level>/<col>_<row>.png. Only the full resolution level is
+// rendered; each lower level is downsampled from the tiles written for the
+// level above, so the canvas is never held in memory as a whole.
+class TilePyramid {
+    static constexpr int kTileSize = 256;
+
+    const std::vector<Symbol>& symbols;
+    const std::vector<Placement>& placements;
+    double width, height;
+    std::string name;
+    RenderOptions options;
+
+    int maxLevel() const {
+        return std::ceil(std::log2(std::max({width, height, 1.0})));
+    }
+
+    int levelWidth(int level) const {
+        return std::ceil(width/std::ldexp(1, maxLevel()-level));
+    }
+
+    int levelHeight(int level) const {
+        return std::ceil(height/std::ldexp(1, maxLevel()-level));
+    }
+
+    int columns(int level) const {
+        return (levelWidth(level)+kTileSize-1)/kTileSize;
+    }
+
+    int rows(int level) const {
+        return (levelHeight(level)+kTileSize-1)/kTileSize;
+    }
+
+    std::string tilePath(int level, int col, int row) const {
+        return name + "_files/" + std::to_string(level) + "/" + std::to_string(col) + "_" + std::to_string(row) + ".png";
+    }
+
+    Cairo::RefPtr<Cairo::ImageSurface> createTile(int level, int col, int row) const {
+        int w = std::min(kTileSize, levelWidth(level)-col*kTileSize);
+        int h = std::min(kTileSize, levelHeight(level)-row*kTileSize);
+        return Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, w, h);
+    }
+
+    void renderLevel(int level) const {
+        int cols = columns(level), tile_rows = rows(level);
+
+        // Bucket symbols by the tiles their bounding box touches
+        std::vector<std::vector<size_t>> tiles(cols*tile_rows);
+        for (size_t i = 0; i < placements.size(); i++) {
+            const auto& placement = placements[i];
+            const auto& symbol = symbols[placement.symbol];
+            int col_end = std::min(cols-1, int((placement.x+symbol.width())/kTileSize));
+            int row_end = std::min(tile_rows-1, int((placement.y+symbol.height())/kTileSize));
+            for (int row = placement.y/kTileSize; row <= row_end; row++) {
+                for (int col = placement.x/kTileSize; col <= col_end; col++) {
+                    tiles[row*cols+col].push_back(i);
+                }
+            }
+        }
+
+        parallelFor(tiles.size(), [&](int i) {
+            int col = i%cols, row = i/cols;
+            auto tile = createTile(level, col, row);
+            auto cr = Cairo::Context::create(tile);
+            applyRasterProfile(cr, options);
+            cr->set_source_rgb(1, 1, 1);
+            cr->paint();
+            cr->set_source_rgb(0, 0, 0);
+            for (size_t j : tiles[i]) {
+                cr->save();
+                cr->translate(placements[j].x-col*kTileSize, placements[j].y-row*kTileSize);
+                symbols[placements[j].symbol].draw(cr, options);
+                cr->restore();
+            }
+            TraceSpan span("write", "io");
+            tile->write_to_png(tilePath(level, col, row));
+        });
+    }
+
+    void downsampleLevel(int level) const {
+        int cols = columns(level);
+        parallelFor(cols*rows(level), [&](int i) {
+            int col = i%cols, row = i/cols;
+            auto tile = createTile(level, col, row);
+            auto cr = Cairo::Context::create(tile);
+            cr->scale(0.5, 0.5);
+            for (int child = 0; child < 4; child++) {
+                int child_col = 2*col+child%2, child_row = 2*row+child/2;
+                if (child_col < columns(level+1) && child_row < rows(level+1)) {
+                    TraceSpan span("read", "io");
+                    auto source = Cairo::ImageSurface::create_from_png(tilePath(level+1, child_col, child_row));
+                    cr->set_source(source, (child%2)*kTileSize, (child/2)*kTileSize);
+                    cr->paint();
+                }
+            }
+            TraceSpan span("write", "io");
+            tile->write_to_png(tilePath(level, col, row));
+        });
+    }
+public:
+    TilePyramid(const std::vector<Symbol>& _symbols, const std::vector<Placement>& _placements,
+                double _width, double _height, std::string _name, const RenderOptions& _options = RenderOptions()) :
+        symbols(_symbols), placements(_placements), width(_width), height(_height), name(_name), options(_options) { }
+
+    void write() const {
+        // Measure every label up front so the render threads only read the caches
+        for (const auto& symbol: symbols) {
+            symbol.width();
+            symbol.height();
+        }
+
+        for (int level = maxLevel(); level >= 0; level--) {
+            std::filesystem::create_directories(name + "_files/" + std::to_string(level));
+            if (level == maxLevel()) {
+                renderLevel(level);
+            } else {
+                downsampleLevel(level);
+            }
+        }
+
+        std::ofstream dzi(name + ".dzi");
+        dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\"" << kTileSize << "\">\n"
+            << "  <Size Width=\"" << std::ceil(width) << "\" Height=\"" << std::ceil(height) << "\"/>\n"
+            << "</Image>\n";
+    }
+};
+
+#endif
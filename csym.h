@@ -0,0 +1,426 @@
+#ifndef CSYM_H
+#define CSYM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ft2build.h>
+#include FT_TRUETYPE_TABLES_H
+#include "cairo-symbol.h"
+
+// Compiled symbol files (.csym) hold symbols together with their layout and
+// shaped labels for the default font, so they can be drawn by walking the
+// records without shaping, measuring or parsing any text. The file is a
+// header followed by arrays of fixed size records and a table of NUL
+// terminated strings, all in native byte order and meant to be mapped into
+// memory. Sections and pins of a symbol are contiguous, in drawing order.
+// Glyph ids and extents only hold for the font they were shaped with, so the
+// header names it and files are refused by contexts with another font.
+
+static constexpr char kCsymMagic[4] = { 'C', 'S', 'Y', 'M' };
+static constexpr uint32_t kCsymVersion = 3;
+
+struct CsymHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t symbol_count;
+    uint32_t section_count;
+    uint32_t pin_count;
+    uint32_t glyph_count;
+    uint32_t strings_size;
+    uint32_t font_checksum;
+    uint64_t symbols_offset;
+    uint64_t sections_offset;
+    uint64_t pins_offset;
+    uint64_t glyphs_offset;
+    uint64_t strings_offset;
+    double font_size;
+    uint32_t font_family;
+    uint32_t font_style;
+};
+
+// The face and size of a context's current font. FreeType faces are told
+// apart by their head table's checksum adjustment, which covers the whole
+// font file; other faces only by size.
+struct CsymFont {
+    std::string family, style;
+    uint32_t checksum = 0;
+    double size = 0;
+
+    bool operator==(const CsymFont& other) const {
+        return family == other.family && style == other.style && checksum == other.checksum && size == other.size;
+    }
+
+    std::string describe() const {
+        char details[48];
+        std::snprintf(details, sizeof(details), " at %g (checksum %08x)", size, checksum);
+        std::string result = family.empty() ? "unknown font" : family;
+        if (!style.empty()) {
+            result += " " + style;
+        }
+        return result + details;
+    }
+
+    static CsymFont of(Cairo::RefPtr<Cairo::Context> ctx) {
+        CsymFont font;
+        cairo_matrix_t font_matrix;
+        cairo_get_font_matrix(ctx->cobj(), &font_matrix);
+        font.size = font_matrix.yy;
+        cairo_scaled_font_t* scaled_font = ctx->get_scaled_font()->cobj();
+        if (cairo_scaled_font_get_type(scaled_font) != CAIRO_FONT_TYPE_FT) {
+            return font;
+        }
+        FT_Face face = cairo_ft_scaled_font_lock_face(scaled_font);
+        if (face) {
+            font.family = face->family_name ? face->family_name : "";
+            font.style = face->style_name ? face->style_name : "";
+            auto head = static_cast<const TT_Header*>(FT_Get_Sfnt_Table(face, FT_SFNT_HEAD));
+            font.checksum = head ? uint32_t(head->CheckSum_Adjust) : uint32_t(face->num_glyphs);
+            cairo_ft_scaled_font_unlock_face(scaled_font);
+        }
+        return font;
+    }
+};
+
+// A run of glyphs within the glyph array
+struct CsymRun {
+    uint32_t first_glyph;
+    uint32_t glyph_count;
+};
+
+// Laid out like cairo_glyph_t, so runs can be drawn from the mapping directly
+struct CsymGlyph {
+    uint64_t index;
+    double x, y;
+};
+
+static_assert(sizeof(CsymGlyph) == sizeof(Cairo::Glyph) && offsetof(CsymGlyph, x) == offsetof(Cairo::Glyph, x) &&
+              offsetof(CsymGlyph, y) == offsetof(Cairo::Glyph, y), "CsymGlyph must match cairo_glyph_t");
+
+struct CsymSymbol {
+    Cairo::Rectangle frame;
+    double width, height;
+    double name_x, name_y;
+    Cairo::TextExtents name_extents;
+    CsymRun name_run;
+    uint32_t name;
+    uint32_t first_section;
+    uint32_t section_count;
+    uint32_t reserved;
+};
+
+struct CsymSection {
+    Cairo::Rectangle pos;
+    uint32_t name;
+    uint32_t first_pin;
+    uint32_t pin_count;
+    uint32_t reserved;
+};
+
+struct CsymPin {
+    Cairo::Rectangle pos;
+    Cairo::TextExtents name_extents, type_extents;
+    CsymRun name_run, type_run;
+    uint32_t name;
+    uint32_t type;
+    uint8_t direction;
+    uint8_t is_bus;
+    uint8_t reserved[6];
+};
+
+static_assert(sizeof(CsymHeader)%8 == 0 && sizeof(CsymSymbol)%8 == 0 &&
+              sizeof(CsymSection)%8 == 0 && sizeof(CsymPin)%8 == 0, "records must keep 8 byte alignment");
+
+inline void writeCsym(std::ostream& out, const std::vector<Symbol>& symbols) {
+    std::vector<CsymSymbol> symbol_records;
+    std::vector<CsymSection> section_records;
+    std::vector<CsymPin> pin_records;
+    std::vector<CsymGlyph> glyphs;
+    std::string strings;
+    auto addString = [&strings](std::string_view str) {
+        uint32_t offset = strings.size();
+        strings.append(str);
+        strings.push_back('\0');
+        return offset;
+    };
+    auto addRun = [&glyphs](const GlyphRun& run) {
+        CsymRun record = { (uint32_t)glyphs.size(), (uint32_t)run.count };
+        for (size_t i = 0; i < run.count; i++) {
+            glyphs.push_back({ run.glyphs[i].index, run.glyphs[i].x, run.glyphs[i].y });
+        }
+        return record;
+    };
+
+    // Symbols are measured in the default font of measureContext()
+    CsymFont font = CsymFont::of(measureContext());
+    uint32_t font_family = addString(font.family), font_style = addString(font.style);
+
+    for (const auto& symbol: symbols) {
+        CsymSymbol record = {};
+        record.frame = symbol.frame();
+        record.width = symbol.width();
+        record.height = symbol.height();
+        symbol.namePosition(record.frame, record.name_x, record.name_y);
+        record.name_extents = symbol.nameExtents();
+        record.name_run = addRun(symbol.nameRun());
+        record.name = addString(symbol.getName());
+        record.first_section = section_records.size();
+        symbol.forEachSection(record.frame, [&](const Section& section, const Cairo::Rectangle& pos) {
+            CsymSection section_record = {};
+            section_record.pos = pos;
+            section_record.name = addString(section.getName());
+            section_record.first_pin = pin_records.size();
+            section.forEachPin(pos, [&](const Pin& pin, const Cairo::Rectangle& pin_pos) {
+                CsymPin pin_record = {};
+                pin_record.pos = pin_pos;
+                GlyphRun name_run = pin.nameRun(), type_run = pin.typeRun();
+                pin_record.name_extents = name_run.extents;
+                pin_record.type_extents = type_run.extents;
+                pin_record.name_run = addRun(name_run);
+                pin_record.type_run = addRun(type_run);
+                pin_record.name = addString(pin.getName());
+                pin_record.type = addString(pin.getType());
+                pin_record.direction = pin.getDirection();
+                pin_record.is_bus = pin.isBus();
+                pin_records.push_back(pin_record);
+            });
+            section_record.pin_count = pin_records.size()-section_record.first_pin;
+            section_records.push_back(section_record);
+        });
+        record.section_count = section_records.size()-record.first_section;
+        symbol_records.push_back(record);
+    }
+
+    CsymHeader header = {};
+    std::memcpy(header.magic, kCsymMagic, sizeof(header.magic));
+    header.version = kCsymVersion;
+    header.symbol_count = symbol_records.size();
+    header.section_count = section_records.size();
+    header.pin_count = pin_records.size();
+    header.glyph_count = glyphs.size();
+    header.strings_size = strings.size();
+    header.font_checksum = font.checksum;
+    header.font_size = font.size;
+    header.font_family = font_family;
+    header.font_style = font_style;
+    header.symbols_offset = sizeof(header);
+    header.sections_offset = header.symbols_offset+symbol_records.size()*sizeof(CsymSymbol);
+    header.pins_offset = header.sections_offset+section_records.size()*sizeof(CsymSection);
+    header.glyphs_offset = header.pins_offset+pin_records.size()*sizeof(CsymPin);
+    header.strings_offset = header.glyphs_offset+glyphs.size()*sizeof(CsymGlyph);
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(symbol_records.data()), symbol_records.size()*sizeof(CsymSymbol));
+    out.write(reinterpret_cast<const char*>(section_records.data()), section_records.size()*sizeof(CsymSection));
+    out.write(reinterpret_cast<const char*>(pin_records.data()), pin_records.size()*sizeof(CsymPin));
+    out.write(reinterpret_cast<const char*>(glyphs.data()), glyphs.size()*sizeof(CsymGlyph));
+    out.write(strings.data(), strings.size());
+}
+
+// Read-only mapping of a .csym file. Everything is validated once on open so
+// that drawing can trust the offsets.
+class CsymFile {
+    void* data = MAP_FAILED;
+    size_t size = 0;
+
+    const CsymHeader* header;
+    const CsymSymbol* symbols;
+    const CsymSection* sections;
+    const CsymPin* pins;
+    const CsymGlyph* glyphs;
+    const char* strings;
+
+    // Last face checkFont() accepted, referenced, so it isn't identified again
+    // for every symbol
+    mutable std::mutex font_mutex;
+    mutable cairo_font_face_t* checked_face = nullptr;
+
+    template <typename T>
+    const T* array(uint64_t offset, uint64_t count) const {
+        if (offset%alignof(T) != 0 || offset > size || count > (size-offset)/sizeof(T)) {
+            throw std::runtime_error("truncated .csym file");
+        }
+        return reinterpret_cast<const T*>(static_cast<const char*>(data)+offset);
+    }
+
+    bool validRun(const CsymRun& run) const {
+        return run.first_glyph <= header->glyph_count && run.glyph_count <= header->glyph_count-run.first_glyph;
+    }
+
+    GlyphRun glyphRun(const CsymRun& run, const Cairo::TextExtents& extents) const {
+        return { reinterpret_cast<const Cairo::Glyph*>(glyphs+run.first_glyph), run.glyph_count, extents };
+    }
+
+    void validate() {
+        if (size < sizeof(CsymHeader)) {
+            throw std::runtime_error("not a .csym file");
+        }
+        header = static_cast<const CsymHeader*>(data);
+        if (std::memcmp(header->magic, kCsymMagic, sizeof(kCsymMagic)) != 0) {
+            throw std::runtime_error("not a .csym file");
+        }
+        if (header->version != kCsymVersion) {
+            throw std::runtime_error("unsupported .csym version " + std::to_string(header->version));
+        }
+        symbols = array<CsymSymbol>(header->symbols_offset, header->symbol_count);
+        sections = array<CsymSection>(header->sections_offset, header->section_count);
+        pins = array<CsymPin>(header->pins_offset, header->pin_count);
+        glyphs = array<CsymGlyph>(header->glyphs_offset, header->glyph_count);
+        strings = array<char>(header->strings_offset, header->strings_size);
+        if (header->strings_size == 0 || strings[header->strings_size-1] != '\0') {
+            throw std::runtime_error("corrupt .csym string table");
+        }
+        if (header->font_family >= header->strings_size || header->font_style >= header->strings_size) {
+            throw std::runtime_error("corrupt .csym font");
+        }
+
+        for (uint32_t i = 0; i < header->symbol_count; i++) {
+            const auto& symbol = symbols[i];
+            if (symbol.name >= header->strings_size || !validRun(symbol.name_run) ||
+                symbol.first_section > header->section_count || symbol.section_count > header->section_count-symbol.first_section) {
+                throw std::runtime_error("corrupt .csym symbol record");
+            }
+        }
+        for (uint32_t i = 0; i < header->section_count; i++) {
+            const auto& section = sections[i];
+            if (section.name >= header->strings_size ||
+                section.first_pin > header->pin_count || section.pin_count > header->pin_count-section.first_pin) {
+                throw std::runtime_error("corrupt .csym section record");
+            }
+        }
+        for (uint32_t i = 0; i < header->pin_count; i++) {
+            const auto& pin = pins[i];
+            if (pin.name >= header->strings_size || pin.type >= header->strings_size || pin.direction > INOUT ||
+                !validRun(pin.name_run) || !validRun(pin.type_run)) {
+                throw std::runtime_error("corrupt .csym pin record");
+            }
+        }
+    }
+public:
+    CsymFile(const std::string& filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("could not open " + filename);
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size = st.st_size;
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("could not map " + filename);
+        }
+        try {
+            validate();
+        } catch (...) {
+            munmap(data, size);
+            throw;
+        }
+    }
+
+    ~CsymFile() {
+        if (checked_face) {
+            cairo_font_face_destroy(checked_face);
+        }
+        munmap(data, size);
+    }
+
+    CsymFile(const CsymFile&) = delete;
+    CsymFile& operator=(const CsymFile&) = delete;
+
+    size_t symbolCount() const {
+        return header->symbol_count;
+    }
+
+    const CsymSymbol& getSymbol(size_t index) const {
+        return symbols[index];
+    }
+
+    const char* getString(uint32_t offset) const {
+        return strings+offset;
+    }
+
+    CsymFont getFont() const {
+        CsymFont font;
+        font.family = strings+header->font_family;
+        font.style = strings+header->font_style;
+        font.checksum = header->font_checksum;
+        font.size = header->font_size;
+        return font;
+    }
+
+    // Throws std::runtime_error unless ctx's current font is the one the file
+    // was compiled with
+    void checkFont(Cairo::RefPtr<Cairo::Context> ctx) const {
+        cairo_matrix_t font_matrix;
+        cairo_get_font_matrix(ctx->cobj(), &font_matrix);
+        cairo_font_face_t* face = cairo_scaled_font_get_font_face(ctx->get_scaled_font()->cobj());
+        std::lock_guard<std::mutex> lock(font_mutex);
+        if (face == checked_face && font_matrix.yy == header->font_size) {
+            return;
+        }
+        CsymFont current = CsymFont::of(ctx), compiled = getFont();
+        if (!(current == compiled)) {
+            throw std::runtime_error("compiled for " + compiled.describe() + ", not " + current.describe());
+        }
+        if (checked_face) {
+            cairo_font_face_destroy(checked_face);
+        }
+        checked_face = cairo_font_face_reference(face);
+    }
+
+    // Same output as Symbol::draw() for the symbol this record was compiled
+    // from; throws std::runtime_error if ctx has another font
+    void draw(Cairo::RefPtr<Cairo::Context> ctx, size_t index, const RenderOptions& options = RenderOptions()) const {
+        checkFont(ctx);
+        const CsymSymbol& symbol = symbols[index];
+        bool greeked = isGreeked(ctx, options);
+
+        ctx->save();
+        if (greeked) {
+            drawGreekedText(ctx, symbol.name_x, symbol.name_y, symbol.name_extents);
+        } else {
+            drawText(ctx, symbol.name_x, symbol.name_y, glyphRun(symbol.name_run, symbol.name_extents));
+        }
+        ctx->restore();
+
+        for (const CsymSection* section = sections+symbol.first_section;
+             section != sections+symbol.first_section+symbol.section_count; section++) {
+            TraceSpan span("section", "draw");
+            ctx->save();
+            strokeRectangle(ctx, section->pos.x, section->pos.y, section->pos.width, section->pos.height);
+            for (const CsymPin* pin = pins+section->first_pin; pin != pins+section->first_pin+section->pin_count; pin++) {
+                drawPin(ctx, *pin, greeked);
+            }
+            ctx->restore();
+        }
+    }
+
+    void drawPin(Cairo::RefPtr<Cairo::Context> ctx, const CsymPin& pin, bool greeked = false) const {
+        TraceSpan span("pin", "draw", true);
+        Pin::drawMeasured(ctx, pin.pos, PinDirection(pin.direction), pin.is_bus,
+                          glyphRun(pin.name_run, pin.name_extents), glyphRun(pin.type_run, pin.type_extents), greeked);
+    }
+
+    // Calls fn(pin) for every pin record of a symbol, in drawing order
+    template <typename Fn>
+    void forEachPin(size_t index, Fn fn) const {
+        const CsymSymbol& symbol = symbols[index];
+        for (const CsymSection* section = sections+symbol.first_section;
+             section != sections+symbol.first_section+symbol.section_count; section++) {
+            for (const CsymPin* pin = pins+section->first_pin; pin != pins+section->first_pin+section->pin_count; pin++) {
+                fn(*pin);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "cairo-symbol.h"
+#include "imagecompare.h"
+
+// Golden-image regression check: every symbol is rendered to an image and
+// compared against <golden directory>/<name>.png, allowing each channel to
+// be off by tolerance. A diff image is written for every mismatch, showing
+// the new rendering faded with the differing pixels in red.
+class GoldenCheck {
+    static constexpr double kMargin = 2;
+
+    const std::vector<Symbol>& symbols;
+    std::string golden_directory;
+    unsigned char tolerance;
+    RenderOptions options;
+
+    Cairo::RefPtr<Cairo::ImageSurface> render(const Symbol& symbol) const {
+        auto image = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, std::ceil(symbol.width()+2*kMargin),
+                                                 std::ceil(symbol.height()+2*kMargin));
+        auto cr = Cairo::Context::create(image);
+        applyRasterProfile(cr, options);
+        cr->set_source_rgb(1, 1, 1);
+        cr->paint();
+        cr->set_source_rgb(0, 0, 0);
+        cr->translate(kMargin, kMargin);
+        symbol.draw(cr, options);
+        return image;
+    }
+
+    // Image file name of every symbol; throws std::runtime_error if two
+    // symbols share a name, as they would share a golden image
+    std::vector<std::string> fileNames() const {
+        std::vector<std::string> file_names;
+        std::unordered_set<std::string_view> seen;
+        for (const auto& symbol: symbols) {
+            if (!seen.insert(symbol.getName()).second) {
+                throw std::runtime_error(golden_directory + ": more than one symbol named \"" +
+                                         std::string(symbol.getName()) + "\"");
+            }
+            file_names.push_back(pngFileName(symbol.getName()));
+        }
+        return file_names;
+    }
+
+    // Runs fn, adding the path to whatever it throws, as cairo's PNG errors
+    // don't say which file they are about
+    template <typename Fn>
+    static void withPath(const std::string& path, Fn fn) {
+        try {
+            fn();
+        } catch (const std::exception& e) {
+            throw std::runtime_error(path + ": " + e.what());
+        }
+    }
+public:
+    GoldenCheck(const std::vector<Symbol>& _symbols, std::string _golden_directory, unsigned char _tolerance = 0,
+                const RenderOptions& _options = RenderOptions()) :
+        symbols(_symbols), golden_directory(_golden_directory), tolerance(_tolerance), options(_options) { }
+
+    // Replaces the golden images with the current rendering; throws
+    // std::runtime_error if an image can't be written
+    void update() const {
+        std::vector<std::string> file_names = fileNames();
+        std::filesystem::create_directories(golden_directory);
+        for (const auto& symbol: symbols) {
+            symbol.width();
+        }
+        parallelFor(symbols.size(), [&](int i) {
+            std::string golden = golden_directory + "/" + file_names[i];
+            withPath(golden, [&] { render(symbols[i])->write_to_png(golden); });
+        });
+    }
+
+    // Compares every symbol against its golden image, writes a diff image
+    // into diff_directory for each one that fails and returns their names.
+    // A missing golden image counts as a failure; one that can't be read, or
+    // a diff image that can't be written, throws std::runtime_error.
+    std::vector<std::string> run(const std::string& diff_directory) const {
+        std::vector<std::string> file_names = fileNames();
+        // Measure every label up front so the render threads only read the caches
+        for (const auto& symbol: symbols) {
+            symbol.width();
+        }
+
+        std::vector<char> failed(symbols.size());
+        std::once_flag created;
+        parallelFor(symbols.size(), [&](int i) {
+            const std::string& file_name = file_names[i];
+            std::string golden = golden_directory + "/" + file_name;
+            auto actual = render(symbols[i]);
+            if (!std::filesystem::exists(golden)) {
+                failed[i] = true;
+                return;
+            }
+            Cairo::RefPtr<Cairo::ImageSurface> expected;
+            withPath(golden, [&] { expected = Cairo::ImageSurface::create_from_png(golden); });
+            if (imageDifferences(expected, actual, tolerance) > 0) {
+                failed[i] = true;
+                std::string diff = diff_directory + "/" + file_name;
+                withPath(diff, [&] {
+                    std::call_once(created, [&] { std::filesystem::create_directories(diff_directory); });
+                    diffImage(expected, actual, tolerance)->write_to_png(diff);
+                });
+            }
+        });
+
+        std::vector<std::string> names;
+        for (size_t i = 0; i < symbols.size(); i++) {
+            if (failed[i]) {
+                names.emplace_back(symbols[i].getName());
+            }
+        }
+        return names;
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef IMAGECOMPARE_H
+#define IMAGECOMPARE_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// True if the two rows of n bytes are identical
+inline bool rowsEqual(const unsigned char* a, const unsigned char* b, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i+64 <= n; i += 64) {
+        __m128i eq = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+i)), _mm_loadu_si128((const __m128i*)(b+i))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+i+16)), _mm_loadu_si128((const __m128i*)(b+i+16)))),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+i+32)), _mm_loadu_si128((const __m128i*)(b+i+32))),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+i+48)), _mm_loadu_si128((const __m128i*)(b+i+48)))));
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            return false;
+        }
+    }
+    for (; i+16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+i)), _mm_loadu_si128((const __m128i*)(b+i)));
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            return false;
+        }
+    }
+#endif
+    return std::memcmp(a+i, b+i, n-i) == 0;
+}
+
+// Compares the pixels of two 32 bit image surfaces, ignoring row padding
+inline bool imagesEqual(Cairo::RefPtr<Cairo::ImageSurface> a, Cairo::RefPtr<Cairo::ImageSurface> b) {
+    if (a->get_width() != b->get_width() || a->get_height() != b->get_height()) {
+        return false;
+    }
+    a->flush();
+    b->flush();
+    const unsigned char* a_data = a->get_data();
+    const unsigned char* b_data = b->get_data();
+    for (int y = 0; y < a->get_height(); y++) {
+        if (!rowsEqual(a_data+y*a->get_stride(), b_data+y*b->get_stride(), 4*a->get_width())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if any channel of the two pixels differs by more than tolerance
+inline bool pixelDiffers(const unsigned char* a, const unsigned char* b, int tolerance) {
+    for (int c = 0; c < 4; c++) {
+        if (std::abs(a[c]-b[c]) > tolerance) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Number of the n 32 bit pixels in the two rows that differ by more than tolerance
+inline size_t rowDifferences(const unsigned char* a, const unsigned char* b, size_t n, unsigned char tolerance) {
+    size_t count = 0, i = 0;
+#ifdef __SSE2__
+    const __m128i limit = _mm_set1_epi8(char(tolerance));
+    for (; i+4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a+4*i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b+4*i));
+        __m128i diff = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+        // One bit per channel over the tolerance, folded to one bit per pixel
+        unsigned over = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(diff, limit), diff)) & 0xffff;
+        count += __builtin_popcount((over | over>>1 | over>>2 | over>>3) & 0x1111);
+    }
+#endif
+    for (; i < n; i++) {
+        count += pixelDiffers(a+4*i, b+4*i, tolerance);
+    }
+    return count;
+}
+
+// Number of pixels differing by more than tolerance; images of different
+// sizes differ everywhere
+inline size_t imageDifferences(Cairo::RefPtr<Cairo::ImageSurface> a, Cairo::RefPtr<Cairo::ImageSurface> b, unsigned char tolerance) {
+    int width = a->get_width(), height = a->get_height();
+    if (width != b->get_width() || height != b->get_height()) {
+        return size_t(std::max(width, b->get_width()))*std::max(height, b->get_height());
+    }
+    a->flush();
+    b->flush();
+    size_t count = 0;
+    for (int y = 0; y < height; y++) {
+        const unsigned char* a_row = a->get_data()+y*a->get_stride();
+        const unsigned char* b_row = b->get_data()+y*b->get_stride();
+        if (!rowsEqual(a_row, b_row, 4*width)) {
+            count += rowDifferences(a_row, b_row, width, tolerance);
+        }
+    }
+    return count;
+}
+
+// Faded copy of actual with every pixel that differs from expected in red
+inline Cairo::RefPtr<Cairo::ImageSurface> diffImage(Cairo::RefPtr<Cairo::ImageSurface> expected, Cairo::RefPtr<Cairo::ImageSurface> actual,
+                                                    unsigned char tolerance) {
+    int width = std::max(expected->get_width(), actual->get_width());
+    int height = std::max(expected->get_height(), actual->get_height());
+    auto image = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+    auto cr = Cairo::Context::create(image);
+    cr->set_source_rgb(1, 1, 1);
+    cr->paint();
+    cr->set_source(actual, 0, 0);
+    cr->paint_with_alpha(0.25);
+    image->flush();
+    expected->flush();
+    actual->flush();
+
+    // ARGB32 is native endian, so an opaque red pixel is a single word
+    const uint32_t red = 0xffff0000;
+    for (int y = 0; y < height; y++) {
+        uint32_t* row = reinterpret_cast<uint32_t*>(image->get_data()+y*image->get_stride());
+        for (int x = 0; x < width; x++) {
+            bool inside = x < expected->get_width() && y < expected->get_height() &&
+                          x < actual->get_width() && y < actual->get_height();
+            if (!inside || pixelDiffers(expected->get_data()+y*expected->get_stride()+4*x,
+                                        actual->get_data()+y*actual->get_stride()+4*x, tolerance)) {
+                row[x] = red;
+            }
+        }
+    }
+    image->mark_dirty();
+    return image;
+}
+
+// File name for a PNG of the named symbol. [A-Za-z0-9_.-] are kept and any
+// other byte is written as '~' and two hex digits, so that different names,
+// such as "a/b" and "a_b", never share a file.
+inline std::string pngFileName(std::string_view name) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string file_name;
+    for (char c: name) {
+        unsigned char byte = c;
+        if (std::isalnum(byte) || c == '_' || c == '-' || c == '.') {
+            file_name += c;
+        } else {
+            file_name += '~';
+            file_name += hex[byte >> 4];
+            file_name += hex[byte & 15];
+        }
+    }
+    return file_name + ".png";
+}
+
+#endif
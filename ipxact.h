@@ -0,0 +1,360 @@
+#ifndef IPXACT_H
+#define IPXACT_H
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "cairo-symbol.h"
+
+// Streaming (SAX style) reader for the subset of XML that IP-XACT uses:
+// elements, attributes, text, comments, CDATA, processing instructions and
+// a DOCTYPE without an internal subset. Nothing is built; the handler sees
+// start(path), text(path, raw) and end(path), with path the local names
+// (namespace prefix dropped) of the open elements, innermost last. Text is
+// passed raw, decode() resolves its entities for the handlers that keep it.
+class SaxReader {
+    std::string_view xml;
+    size_t offset = 0;
+    int line = 1;
+    std::vector<std::string_view> open, path;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+    }
+
+    // Moves offset just past the next occurrence of terminator
+    void skipPast(std::string_view terminator) {
+        size_t end = xml.find(terminator, offset);
+        if (end == std::string_view::npos) {
+            fail("expected '" + std::string(terminator) + "'");
+        }
+        end += terminator.size();
+        for (; offset < end; offset++) {
+            line += xml[offset] == '\n';
+        }
+    }
+
+    void skipSpace() {
+        while (offset < xml.size() && std::isspace((unsigned char)xml[offset])) {
+            line += xml[offset++] == '\n';
+        }
+    }
+
+    static bool isNameChar(char c) {
+        return !std::strchr(" \t\r\n/>=\"'", c) && c != '\0';
+    }
+
+    std::string_view name() {
+        size_t start = offset;
+        while (offset < xml.size() && isNameChar(xml[offset])) {
+            offset++;
+        }
+        if (offset == start) {
+            fail("expected a name");
+        }
+        return xml.substr(start, offset-start);
+    }
+
+    static std::string_view localName(std::string_view name) {
+        size_t colon = name.find(':');
+        return (colon == std::string_view::npos) ? name : name.substr(colon+1);
+    }
+
+    // Attributes are not needed by the importers, only stepped over
+    bool startTag() {
+        std::string_view tag = name();
+        while (true) {
+            skipSpace();
+            if (offset >= xml.size()) {
+                fail("unterminated <" + std::string(tag) + ">");
+            }
+            char c = xml[offset];
+            if (c == '>' || xml.compare(offset, 2, "/>") == 0) {
+                offset += (c == '>') ? 1 : 2;
+                open.push_back(tag);
+                path.push_back(localName(tag));
+                return c != '>';
+            }
+            name();
+            // Eq ::= S? '=' S?
+            skipSpace();
+            if (offset >= xml.size() || xml[offset] != '=') {
+                fail("expected '=' after attribute name");
+            }
+            offset++;
+            skipSpace();
+            if (offset >= xml.size() || (xml[offset] != '"' && xml[offset] != '\'')) {
+                fail("expected a quoted attribute value");
+            }
+            char quote = xml[offset++];
+            skipPast(std::string_view(&quote, 1));
+        }
+    }
+    // Code point of "#N" or "#xN", false unless it is a non-NUL Unicode scalar value
+    static bool characterReference(std::string_view entity, unsigned long& code) {
+        if (entity.size() < 2 || entity[0] != '#') {
+            return false;
+        }
+        bool hex = (entity[1] == 'x');
+        std::string_view digits = entity.substr(hex ? 2 : 1);
+        if (digits.empty()) {
+            return false;
+        }
+        code = 0;
+        for (char c: digits) {
+            int digit;
+            if (c >= '0' && c <= '9') {
+                digit = c-'0';
+            } else if (hex && c >= 'a' && c <= 'f') {
+                digit = c-'a'+10;
+            } else if (hex && c >= 'A' && c <= 'F') {
+                digit = c-'A'+10;
+            } else {
+                return false;
+            }
+            code = code*(hex ? 16 : 10)+digit;
+            if (code > 0x10ffff) {
+                return false;
+            }
+        }
+        return code != 0 && (code < 0xd800 || code > 0xdfff);
+    }
+public:
+    // Text with its character and predefined entity references resolved;
+    // malformed or out of range references are kept as written
+    static std::string decode(std::string_view raw) {
+        std::string text;
+        text.reserve(raw.size());
+        for (size_t i = 0; i < raw.size(); i++) {
+            size_t semicolon = (raw[i] == '&') ? raw.find(';', i) : std::string_view::npos;
+            if (semicolon == std::string_view::npos) {
+                text += raw[i];
+                continue;
+            }
+            std::string_view entity = raw.substr(i+1, semicolon-i-1);
+            static const std::pair<std::string_view, char> predefined[] = {
+                { "lt", '<' }, { "gt", '>' }, { "amp", '&' }, { "quot", '"' }, { "apos", '\'' }
+            };
+            bool known = false;
+            for (const auto& p: predefined) {
+                if (entity == p.first) {
+                    text += p.second;
+                    known = true;
+                }
+            }
+            unsigned long code = 0;
+            if (!known && characterReference(entity, code)) {
+                // UTF-8
+                if (code < 0x80) {
+                    text += char(code);
+                } else if (code < 0x800) {
+                    text += char(0xc0 | (code >> 6));
+                    text += char(0x80 | (code & 0x3f));
+                } else if (code < 0x10000) {
+                    text += char(0xe0 | (code >> 12));
+                    text += char(0x80 | ((code >> 6) & 0x3f));
+                    text += char(0x80 | (code & 0x3f));
+                } else {
+                    text += char(0xf0 | (code >> 18));
+                    text += char(0x80 | ((code >> 12) & 0x3f));
+                    text += char(0x80 | ((code >> 6) & 0x3f));
+                    text += char(0x80 | (code & 0x3f));
+                }
+                known = true;
+            }
+            if (known) {
+                i = semicolon;
+            } else {
+                text += raw[i];
+            }
+        }
+        return text;
+    }
+
+    // Throws std::runtime_error on malformed or unbalanced markup
+    template <typename Handler>
+    void read(std::string_view _xml, Handler& handler) {
+        xml = _xml;
+        offset = 0;
+        line = 1;
+        open.clear();
+        path.clear();
+        while (offset < xml.size()) {
+            if (xml[offset] != '<') {
+                size_t start = offset;
+                const void* next = std::memchr(xml.data()+offset, '<', xml.size()-offset);
+                size_t end = next ? static_cast<const char*>(next)-xml.data() : xml.size();
+                for (; offset < end; offset++) {
+                    line += xml[offset] == '\n';
+                }
+                if (!path.empty()) {
+                    handler.text(path, xml.substr(start, end-start));
+                }
+            } else if (xml.compare(offset, 4, "<!--") == 0) {
+                skipPast("-->");
+            } else if (xml.compare(offset, 9, "<![CDATA[") == 0) {
+                size_t start = offset+9;
+                skipPast("]]>");
+                if (!path.empty()) {
+                    // Already literal, so it must not be decoded; split at any '&'
+                    std::string_view data = xml.substr(start, offset-3-start);
+                    for (size_t amp; (amp = data.find('&')) != std::string_view::npos; data.remove_prefix(amp+1)) {
+                        handler.text(path, data.substr(0, amp));
+                        handler.text(path, "&amp;");
+                    }
+                    handler.text(path, data);
+                }
+            } else if (xml.compare(offset, 2, "<?") == 0) {
+                skipPast("?>");
+            } else if (xml.compare(offset, 2, "<!") == 0) {
+                skipPast(">");
+            } else if (xml.compare(offset, 2, "</") == 0) {
+                offset += 2;
+                std::string_view tag = name();
+                skipPast(">");
+                if (open.empty() || open.back() != tag) {
+                    fail("unexpected </" + std::string(tag) + ">");
+                }
+                handler.end(path);
+                open.pop_back();
+                path.pop_back();
+            } else {
+                offset++;
+                bool empty = startTag();
+                handler.start(path);
+                if (empty) {
+                    handler.end(path);
+                    open.pop_back();
+                    path.pop_back();
+                }
+            }
+        }
+        if (!open.empty()) {
+            fail("unclosed <" + std::string(open.back()) + ">");
+        }
+    }
+};
+
+// IP-XACT component descriptions (IEEE 1685, both the spirit: and ipxact:
+// schemas) as symbols, read in one SAX pass over the document. Bus
+// interfaces come before the model's ports in the schema, so their port
+// maps are known by the time ports arrive: every bus interface gets a
+// section with the physical ports it maps, and ports outside any interface
+// go to a last, unnamed section.
+class IpxactImporter : SaxReader {
+    struct Port {
+        std::string name;
+        PinDirection direction = INOUT;
+        std::string type_name, left, right;
+        bool vector = false;
+    };
+
+    std::string component;
+    std::vector<std::string> interfaces;
+    // Physical port name to the first interface mapping it
+    std::unordered_map<std::string, size_t> mapped;
+    std::vector<Port> ports;
+    Port port;
+    std::string content;
+    bool root = true;
+
+    static bool is(const std::vector<std::string_view>& path, std::string_view parent, std::string_view element) {
+        return path.size() >= 2 && path.back() == element && path[path.size()-2] == parent;
+    }
+
+    static bool keepsText(std::string_view element) {
+        return element == "name" || element == "direction" || element == "left" || element == "right" || element == "typeName";
+    }
+public:
+    void start(const std::vector<std::string_view>& path) {
+        if (root) {
+            if (path.back() != "component") {
+                throw std::runtime_error("not an IP-XACT component");
+            }
+            root = false;
+        }
+        content.clear();
+        if (is(path, "ports", "port")) {
+            port = Port();
+        } else if (is(path, "busInterfaces", "busInterface")) {
+            interfaces.emplace_back();
+        }
+    }
+
+    void text(const std::vector<std::string_view>& path, std::string_view raw) {
+        if (keepsText(path.back())) {
+            content += decode(raw);
+        }
+    }
+
+    void end(const std::vector<std::string_view>& path) {
+        std::string_view element = path.back();
+        if (!keepsText(element) && element != "port") {
+            return;
+        }
+        // Surrounding white space is layout, not content
+        size_t first = content.find_first_not_of(" \t\r\n"), last = content.find_last_not_of(" \t\r\n");
+        std::string value = (first == std::string::npos) ? "" : content.substr(first, last-first+1);
+        if (is(path, "component", "name")) {
+            component = value;
+        } else if (is(path, "busInterface", "name") && !interfaces.empty()) {
+            interfaces.back() = value;
+        } else if (is(path, "physicalPort", "name") && !interfaces.empty()) {
+            mapped.emplace(value, interfaces.size()-1);
+        } else if (is(path, "port", "name") && path.size() >= 3 && path[path.size()-3] == "ports") {
+            port.name = value;
+        } else if (is(path, "wire", "direction")) {
+            port.direction = (value == "in") ? IN : (value == "out") ? OUT : INOUT;
+        } else if (is(path, "vector", "left") && port.left.empty()) {
+            port.left = value;
+        } else if (is(path, "vector", "right") && port.right.empty()) {
+            port.right = value;
+        } else if (is(path, "wireTypeDef", "typeName") && port.type_name.empty()) {
+            port.type_name = value;
+        } else if (is(path, "ports", "port")) {
+            port.vector = !port.left.empty() || !port.right.empty();
+            ports.push_back(std::move(port));
+        }
+        content.clear();
+    }
+
+    // Adds the component's symbol to the library; throws std::runtime_error
+    Symbol& import(SymbolLibrary& library, std::string_view xml) {
+        component.clear();
+        interfaces.clear();
+        mapped.clear();
+        ports.clear();
+        root = true;
+        read(xml, *this);
+        if (root) {
+            throw std::runtime_error("not an IP-XACT component");
+        }
+
+        Symbol& symbol = library.emplaceSymbol(component);
+        std::vector<std::vector<const Port*>> sections(interfaces.size()+1);
+        for (const auto& p: ports) {
+            auto it = mapped.find(p.name);
+            sections[(it == mapped.end()) ? interfaces.size() : it->second].push_back(&p);
+        }
+        for (size_t i = 0; i < sections.size(); i++) {
+            if (sections[i].empty()) {
+                continue;
+            }
+            Section& section = symbol.emplaceSection(i < interfaces.size() ? std::string_view(interfaces[i]) : std::string_view());
+            section.reservePins(sections[i].size());
+            for (const Port* p: sections[i]) {
+                std::string type = p->type_name.empty() ? "wire" : p->type_name;
+                if (p->vector) {
+                    type += " [" + p->left + ":" + p->right + "]";
+                }
+                section.emplacePin(p->name, p->direction, p->vector, type);
+            }
+        }
+        return symbol;
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef KICAD_H
+#define KICAD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include "cairo-symbol.h"
+
+// Writes symbols as a KiCad symbol library (.kicad_sym), one symbol at a
+// time straight to the stream. Every section becomes a unit of the symbol.
+// Eeschema only connects wires to pins on its grid, so units are laid out
+// afresh on a 2.54 mm (100 mil) pitch: inputs down the left edge, all other
+// pins down the right, in the renderer's order, with the box as wide as the
+// renderer's frame rounded up to the grid.
+class KicadWriter {
+    static constexpr double kMillimetresPerPoint = 25.4/72;
+    static constexpr double kFontSize = 1.27;
+    static constexpr double kPitch = 2.54;
+    static constexpr double kPinLength = 2.54;
+
+    std::ostream& out;
+    std::string buffer;
+    bool finished = false;
+
+    void number(double value) {
+        char text[32];
+        int length = std::snprintf(text, sizeof(text), "%.4f", value);
+        // Trailing zeros only bloat the file
+        while (length > 1 && text[length-1] == '0') {
+            length--;
+        }
+        if (text[length-1] == '.') {
+            length--;
+        }
+        if (length == 2 && text[0] == '-' && text[1] == '0') {
+            buffer += '0';
+        } else {
+            buffer.append(text, length);
+        }
+    }
+
+    void point(double x, double y) {
+        number(x);
+        buffer += ' ';
+        number(y);
+    }
+
+    void quoted(std::string_view text) {
+        buffer += '"';
+        for (char c: text) {
+            if (c == '"' || c == '\\') {
+                buffer += '\\';
+            }
+            buffer += c;
+        }
+        buffer += '"';
+    }
+
+    // Library ids use ':' between library and symbol, so it can't be part of a name
+    void symbolName(std::string_view name, int unit = 0) {
+        buffer += '"';
+        for (char c: name) {
+            if (c == '"' || c == '\\') {
+                buffer += '\\';
+            }
+            buffer += (c == ':') ? '_' : c;
+        }
+        if (unit) {
+            buffer += '_';
+            buffer += std::to_string(unit);
+            buffer += "_1";
+        }
+        buffer += '"';
+    }
+
+    void effects(bool hide = false) {
+        buffer += "(effects (font (size ";
+        point(kFontSize, kFontSize);
+        buffer += hide ? ")) hide)" : ")))";
+    }
+
+    void property(const char* key, std::string_view value, int id, double x, double y, bool hide = false) {
+        buffer += "\n    (property ";
+        quoted(key);
+        buffer += ' ';
+        quoted(value);
+        buffer += " (id ";
+        buffer += std::to_string(id);
+        buffer += ") (at ";
+        point(x, y);
+        buffer += " 0) ";
+        effects(hide);
+        buffer += ')';
+    }
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+public:
+    KicadWriter(std::ostream& _out) : out(_out) {
+        buffer += "(kicad_symbol_lib (version 20211014) (generator cairo-symbol)";
+        flush();
+    }
+
+    ~KicadWriter() {
+        finish();
+    }
+
+    // Smallest multiple of the pitch not below mm
+    static double snapUp(double mm) {
+        return std::ceil(mm/kPitch-1e-9)*kPitch;
+    }
+
+    static int rows(const Section& section) {
+        size_t inputs = 0;
+        for (size_t i = 0; i < section.pinCount(); i++) {
+            inputs += section.getPin(i).getDirection() == IN;
+        }
+        return std::max(inputs, section.pinCount()-inputs);
+    }
+
+    void write(const Symbol& symbol) {
+        // All units share the frame's width, so each is as tall as it needs
+        double half_width = snapUp(symbol.frame().width/2*kMillimetresPerPoint);
+        int most_rows = 0;
+        for (size_t i = 0; i < symbol.sectionCount(); i++) {
+            most_rows = std::max(most_rows, rows(symbol.getSection(i)));
+        }
+        double top = (std::max(most_rows-1, 0)/2+1)*kPitch;
+        buffer += "\n  (symbol ";
+        symbolName(symbol.getName());
+        buffer += " (in_bom yes) (on_board yes)";
+        property("Reference", "U", 0, 0, top+2*kFontSize);
+        property("Value", symbol.getName(), 1, 0, top+kFontSize);
+        property("Footprint", "", 2, 0, 0, true);
+        property("Datasheet", "", 3, 0, 0, true);
+
+        int number = 0;
+        for (size_t unit = 0; unit < symbol.sectionCount(); unit++) {
+            const Section& section = symbol.getSection(unit);
+            int count = rows(section);
+            // Pins on the grid, the first row at or just above the middle
+            double first = (std::max(count-1, 0)/2)*kPitch;
+            buffer += "\n    (symbol ";
+            symbolName(symbol.getName(), unit+1);
+            buffer += "\n      (rectangle (start ";
+            point(-half_width, first+kPitch);
+            buffer += ") (end ";
+            point(half_width, first-count*kPitch);
+            buffer += ") (stroke (width 0) (type default)) (fill (type background)))";
+            int left = 0, right = 0;
+            section.forEachPin(Cairo::Rectangle(), [&](const Pin& pin, const Cairo::Rectangle&) {
+                bool input = pin.getDirection() == IN;
+                buffer += "\n      (pin ";
+                buffer += input ? "input" : (pin.getDirection() == OUT) ? "output" : "bidirectional";
+                buffer += " line (at ";
+                point(input ? -half_width-kPinLength : half_width+kPinLength, first-(input ? left++ : right++)*kPitch);
+                buffer += input ? " 0) (length " : " 180) (length ";
+                this->number(kPinLength);
+                buffer += ") (name ";
+                quoted(pin.getName().empty() ? "~" : pin.getName());
+                buffer += ' ';
+                effects();
+                buffer += ") (number ";
+                quoted(std::to_string(++number));
+                buffer += ' ';
+                effects();
+                buffer += "))";
+            });
+            buffer += "\n    )";
+        }
+        buffer += "\n  )";
+        flush();
+    }
+
+    // Closes the library; also done on destruction
+    void finish() {
+        if (!finished) {
+            finished = true;
+            buffer += "\n)\n";
+            flush();
+        }
+    }
+};
+
+#endif
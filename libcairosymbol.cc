@@ -0,0 +1,159 @@
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include "cairo-symbol.h"
+#include "pinindex.h"
+#include "libcairosymbol.h"
+
+static_assert(CAIROSYMBOL_RENDER_MARGIN == kPageMargin, "libcairosymbol.h must give renderToBuffer's margin");
+
+// C handles wrap the C++ objects directly; exceptions must not cross the ABI
+struct cairosymbol_symbol {
+    Symbol symbol;
+    // Built by the first hit test and kept up to date as pins are added
+    mutable std::unique_ptr<PinIndex> index;
+};
+
+unsigned cairosymbol_abi_version(void) {
+    return CAIROSYMBOL_ABI_VERSION;
+}
+
+cairosymbol_symbol* cairosymbol_symbol_new(const char* name) {
+    try {
+        return new cairosymbol_symbol { Symbol(name ? name : ""), nullptr };
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void cairosymbol_symbol_free(cairosymbol_symbol* symbol) {
+    delete symbol;
+}
+
+int cairosymbol_symbol_add_section(cairosymbol_symbol* symbol, const char* name) {
+    if (!symbol) {
+        return -1;
+    }
+    try {
+        symbol->symbol.addSection(Section(name ? name : ""));
+        if (symbol->index) {
+            symbol->index->updateSection(symbol->symbol.sectionCount()-1);
+        }
+        return symbol->symbol.sectionCount()-1;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int cairosymbol_section_add_pin(cairosymbol_symbol* symbol, int section, const char* name,
+                                cairosymbol_pin_direction direction, int is_bus, const char* type) {
+    if (!symbol || !name || section < 0 || (size_t)section >= symbol->symbol.sectionCount()) {
+        return -1;
+    }
+    PinDirection pin_direction;
+    switch (direction) {
+    case CAIROSYMBOL_PIN_IN: pin_direction = IN; break;
+    case CAIROSYMBOL_PIN_OUT: pin_direction = OUT; break;
+    case CAIROSYMBOL_PIN_INOUT: pin_direction = INOUT; break;
+    default: return -1;
+    }
+    try {
+        symbol->symbol.getSection(section).addPin(Pin(name, pin_direction, is_bus, type ? type : ""));
+        if (symbol->index) {
+            symbol->index->updateSection(section);
+        }
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int cairosymbol_symbol_set_max_label_width(cairosymbol_symbol* symbol, double width) {
+    if (!symbol || !(width >= 0)) {
+        return -1;
+    }
+    try {
+        symbol->symbol.setMaxNameWidth(width);
+        // Every pin may have moved
+        symbol->index.reset();
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int cairosymbol_symbol_layout(const cairosymbol_symbol* symbol, double* width, double* height) {
+    if (!symbol) {
+        return -1;
+    }
+    try {
+        if (width) {
+            *width = symbol->symbol.width();
+        }
+        if (height) {
+            *height = symbol->symbol.height();
+        }
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int cairosymbol_symbol_pin_at(const cairosymbol_symbol* symbol, double x, double y, int* section, int* pin) {
+    if (!symbol) {
+        return -1;
+    }
+    try {
+        if (!symbol->index) {
+            symbol->index.reset(new PinIndex(symbol->symbol));
+        }
+        PinIndex::Hit hit;
+        if (!symbol->index->pinAt(x, y, hit)) {
+            return -1;
+        }
+        if (section) {
+            *section = hit.section;
+        }
+        if (pin) {
+            *pin = hit.pin;
+        }
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int cairosymbol_symbol_render(const cairosymbol_symbol* symbol, cairosymbol_format format, double scale,
+                              double lod_threshold, unsigned char** data, size_t* size) {
+    if (!symbol || !data || !size || scale <= 0) {
+        return -1;
+    }
+    OutputFormat output_format;
+    switch (format) {
+    case CAIROSYMBOL_FORMAT_PDF: output_format = PDF; break;
+    case CAIROSYMBOL_FORMAT_SVG: output_format = SVG; break;
+    case CAIROSYMBOL_FORMAT_PNG: output_format = PNG; break;
+    default: return -1;
+    }
+    try {
+        RenderOptions options;
+        options.lod_threshold = lod_threshold;
+        auto buffer = renderToBuffer(symbol->symbol, output_format, scale, options);
+        if (buffer.empty()) {
+            return -1;
+        }
+        *data = static_cast<unsigned char*>(std::malloc(buffer.size()));
+        if (!*data) {
+            return -1;
+        }
+        std::memcpy(*data, buffer.data(), buffer.size());
+        *size = buffer.size();
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+void cairosymbol_buffer_free(unsigned char* data) {
+    std::free(data);
+}
@@ -0,0 +1,66 @@
+#ifndef LIBCAIROSYMBOL_H
+#define LIBCAIROSYMBOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAIROSYMBOL_API __attribute__((visibility("default")))
+
+/* Bumped whenever a function signature or enum value below changes */
+#define CAIROSYMBOL_ABI_VERSION 1
+
+typedef struct cairosymbol_symbol cairosymbol_symbol;
+
+typedef enum {
+    CAIROSYMBOL_PIN_IN = 0,
+    CAIROSYMBOL_PIN_OUT = 1,
+    CAIROSYMBOL_PIN_INOUT = 2
+} cairosymbol_pin_direction;
+
+typedef enum {
+    CAIROSYMBOL_FORMAT_PDF = 0,
+    CAIROSYMBOL_FORMAT_SVG = 1,
+    CAIROSYMBOL_FORMAT_PNG = 2
+} cairosymbol_format;
+
+CAIROSYMBOL_API unsigned cairosymbol_abi_version(void);
+
+/* Functions returning int give 0 on success and -1 on failure */
+CAIROSYMBOL_API cairosymbol_symbol* cairosymbol_symbol_new(const char* name);
+CAIROSYMBOL_API void cairosymbol_symbol_free(cairosymbol_symbol* symbol);
+
+/* Returns the index of the new section, or -1 */
+CAIROSYMBOL_API int cairosymbol_symbol_add_section(cairosymbol_symbol* symbol, const char* name);
+CAIROSYMBOL_API int cairosymbol_section_add_pin(cairosymbol_symbol* symbol, int section, const char* name,
+                                                cairosymbol_pin_direction direction, int is_bus, const char* type);
+
+/* Pin names wider than width points are drawn cut short with an ellipsis, 0 for no limit */
+CAIROSYMBOL_API int cairosymbol_symbol_set_max_label_width(cairosymbol_symbol* symbol, double width);
+
+/* Size of the symbol's bounding box in points */
+CAIROSYMBOL_API int cairosymbol_symbol_layout(const cairosymbol_symbol* symbol, double* width, double* height);
+
+/* Blank border around the symbol in buffers from cairosymbol_symbol_render(), in points */
+#define CAIROSYMBOL_RENDER_MARGIN 2.0
+
+/* Section and pin index of the pin drawn under (x, y), or -1 if there is none.
+   (x, y) are in the symbol's own points, with (0, 0) at the top left corner
+   of the box from cairosymbol_symbol_layout(). For pixel (px, py) of a PNG
+   rendered at scale, pass px/scale - CAIROSYMBOL_RENDER_MARGIN and
+   py/scale - CAIROSYMBOL_RENDER_MARGIN; PDF and SVG pages map the same way
+   with px, py in page points. */
+CAIROSYMBOL_API int cairosymbol_symbol_pin_at(const cairosymbol_symbol* symbol, double x, double y, int* section, int* pin);
+
+/* On success *data holds *size bytes of encoded output, released with cairosymbol_buffer_free() */
+CAIROSYMBOL_API int cairosymbol_symbol_render(const cairosymbol_symbol* symbol, cairosymbol_format format, double scale,
+                                              double lod_threshold, unsigned char** data, size_t* size);
+CAIROSYMBOL_API void cairosymbol_buffer_free(unsigned char* data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,458 @@
+#ifndef LIBERTY_H
+#define LIBERTY_H
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "cairo-symbol.h"
+#include "mappedfile.h"
+
+// Liberty (.lib) cell libraries as symbols: one per cell, with its pin, bus
+// and bundle groups as pins and any pg_pin groups in a second "power"
+// section. Only the group structure is followed; every group the symbols
+// don't need, which is nearly all of a Liberty file (timing, power and noise
+// tables), is stepped over by a character scan for its closing brace without
+// being tokenized. Bus types may be defined in the library or in the cell,
+// before or after the pins that name them; a cell naming a library type not
+// defined yet is held back, along with the cells after it, until it is.
+class LibertyParser {
+    std::string_view text;
+    size_t offset = 0;
+    int line = 1;
+
+    struct BusType {
+        std::string from, to;
+    };
+    using BusTypes = std::unordered_map<std::string, BusType>;
+    BusTypes bus_types;
+
+    // A pin, bus, bundle or pg_pin group, for as many pins as it names
+    struct CellPin {
+        std::vector<std::string_view> names;
+        std::string_view kind;
+        PinDirection direction = INOUT;
+        std::string_view bus_type, pg_type;
+        bool clock = false;
+    };
+
+    struct Cell {
+        std::string_view name;
+        std::vector<CellPin> pins;
+        BusTypes bus_types;
+    };
+    // Read but not yet handed over, in file order
+    std::deque<Cell> waiting;
+
+    // Thrown through the groups when the cell callback asks to stop
+    struct Stop { };
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+    }
+
+    // White space, comments and backslash line continuations
+    void skipSpace() {
+        while (offset < text.size()) {
+            char c = text[offset];
+            if (c == '\n') {
+                line++;
+                offset++;
+            } else if (std::isspace((unsigned char)c)) {
+                offset++;
+            } else if (c == '\\' && offset+1 < text.size() && (text[offset+1] == '\n' || text[offset+1] == '\r')) {
+                offset++;
+            } else if (text.compare(offset, 2, "/*") == 0) {
+                skipComment();
+            } else if (text.compare(offset, 2, "//") == 0) {
+                size_t end = text.find('\n', offset);
+                offset = (end == std::string_view::npos) ? text.size() : end;
+            } else {
+                break;
+            }
+        }
+    }
+
+    void skipComment() {
+        size_t end = text.find("*/", offset+2);
+        end = (end == std::string_view::npos) ? text.size() : end+2;
+        for (; offset < end; offset++) {
+            line += text[offset] == '\n';
+        }
+    }
+
+    // Offset is on the opening quote; returns the contents
+    std::string_view quoted() {
+        size_t start = ++offset;
+        while (offset < text.size() && text[offset] != '"') {
+            if (text[offset] == '\\') {
+                offset++;
+            }
+            line += offset < text.size() && text[offset] == '\n';
+            offset++;
+        }
+        if (offset >= text.size()) {
+            fail("unterminated string");
+        }
+        return text.substr(start, offset++-start);
+    }
+
+    static bool isWordChar(char c) {
+        return !std::isspace((unsigned char)c) && !std::strchr("(){}:;,\"", c);
+    }
+
+    std::string_view word() {
+        skipSpace();
+        if (offset < text.size() && text[offset] == '"') {
+            return quoted();
+        }
+        size_t start = offset;
+        while (offset < text.size() && isWordChar(text[offset])) {
+            offset++;
+        }
+        return text.substr(start, offset-start);
+    }
+
+    bool at(char c) {
+        skipSpace();
+        return offset < text.size() && text[offset] == c;
+    }
+
+    void expect(char c) {
+        if (!at(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+        offset++;
+    }
+
+    // Steps over a group body whose "{" was just consumed; only braces,
+    // strings and both kinds of comment matter, so this runs at close to memchr speed
+    void skipBody() {
+        for (int depth = 1; depth > 0; ) {
+            size_t next = text.find_first_of("{}\"/\n", offset);
+            if (next == std::string_view::npos) {
+                fail("unterminated group");
+            }
+            offset = next;
+            switch (text[offset]) {
+            case '{':
+                depth++;
+                offset++;
+                break;
+            case '}':
+                depth--;
+                offset++;
+                break;
+            case '"':
+                quoted();
+                break;
+            case '/':
+                if (text.compare(offset, 2, "/*") == 0) {
+                    skipComment();
+                } else if (text.compare(offset, 2, "//") == 0) {
+                    // The newline is left for the scan, which counts it
+                    size_t end = text.find('\n', offset);
+                    offset = (end == std::string_view::npos) ? text.size() : end;
+                } else {
+                    offset++;
+                }
+                break;
+            default:
+                line++;
+                offset++;
+            }
+        }
+    }
+
+    // Statements of a group body up to its "}", or of the file up to its end:
+    // attribute(name, value) for "name : value ;" and group(name, arguments)
+    // for "name (arguments) {", which reads the body with another body() call
+    // or returns false to have it skipped. Complex attributes,
+    // "name (arguments) ;", are ignored.
+    template <typename Attribute, typename Group>
+    void body(Attribute attribute, Group group, bool file = false) {
+        while (!at('}')) {
+            if (offset >= text.size()) {
+                if (file) {
+                    return;
+                }
+                fail("unterminated group");
+            }
+            std::string_view name = word();
+            if (name.empty()) {
+                fail("expected an attribute or group");
+            }
+            if (at(':')) {
+                offset++;
+                std::string_view value = word();
+                attribute(name, value);
+                if (at(';')) {
+                    offset++;
+                }
+            } else if (at('(')) {
+                offset++;
+                std::vector<std::string_view> arguments;
+                while (!at(')')) {
+                    if (offset >= text.size()) {
+                        fail("unterminated argument list");
+                    }
+                    arguments.push_back(word());
+                    // Expressions and units such as "1.0 ns" keep only their first word
+                    while (offset < text.size() && !at(',') && !at(')')) {
+                        if (word().empty()) {
+                            offset++;
+                        }
+                    }
+                    if (at(',')) {
+                        offset++;
+                    }
+                }
+                offset++;
+                if (at('{')) {
+                    offset++;
+                    if (!group(name, arguments)) {
+                        skipBody();
+                        continue;
+                    }
+                } else if (at(';')) {
+                    offset++;
+                }
+            } else {
+                fail("expected ':' or '(' after " + std::string(name));
+            }
+        }
+        if (file) {
+            fail("unexpected '}'");
+        }
+        offset++;
+    }
+
+    // "type (name) { bit_from : 7; bit_to : 0; }" for the buses that name it
+    BusType busType() {
+        BusType type;
+        body([&](std::string_view attribute, std::string_view value) {
+            if (attribute == "bit_from") {
+                type.from = std::string(value);
+            } else if (attribute == "bit_to") {
+                type.to = std::string(value);
+            }
+        }, [](std::string_view, const std::vector<std::string_view>&) {
+            return false;
+        });
+        return type;
+    }
+
+    const BusType* findBusType(const Cell& cell, std::string_view name) const {
+        auto it = cell.bus_types.find(std::string(name));
+        if (it != cell.bus_types.end()) {
+            return &it->second;
+        }
+        it = bus_types.find(std::string(name));
+        return (it != bus_types.end()) ? &it->second : nullptr;
+    }
+
+    bool resolved(const Cell& cell) const {
+        for (const auto& pin: cell.pins) {
+            if (!pin.bus_type.empty() && !findBusType(cell, pin.bus_type)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Fn>
+    void emit(const Cell& cell, Fn& fn) {
+        Symbol symbol(cell.name);
+        Section& signals = symbol.emplaceSection();
+        Section power("power");
+        for (const auto& pin: cell.pins) {
+            bool pg = pin.kind == "pg_pin", bus = pin.kind == "bus" || pin.kind == "bundle";
+            std::string type = bus ? std::string(pin.kind) : "";
+            if (!pin.bus_type.empty()) {
+                type = std::string(pin.bus_type);
+                if (const BusType* bus_type = findBusType(cell, pin.bus_type)) {
+                    type += " [" + bus_type->from + ":" + bus_type->to + "]";
+                }
+            } else if (!pin.pg_type.empty()) {
+                type = std::string(pin.pg_type);
+            }
+            if (pin.clock && type.empty()) {
+                type = "clock";
+            }
+            for (auto pin_name: pin.names) {
+                (pg ? power : signals).emplacePin(pin_name, pin.direction, bus, type);
+            }
+        }
+        if (power.pinCount() > 0) {
+            symbol.addSection(power);
+        }
+        if (!fn(std::move(symbol))) {
+            throw Stop();
+        }
+    }
+
+    // Hands over the waiting cells whose bus types are all known, or with
+    // all of them every waiting cell, in file order
+    template <typename Fn>
+    void release(Fn& fn, bool all = false) {
+        while (!waiting.empty() && (all || resolved(waiting.front()))) {
+            Cell cell = std::move(waiting.front());
+            waiting.pop_front();
+            emit(cell, fn);
+        }
+    }
+
+    template <typename Fn>
+    void cell(std::string_view name, Fn& fn) {
+        Cell& cell = waiting.emplace_back();
+        cell.name = name;
+        body([](std::string_view, std::string_view) { }, [&](std::string_view kind, const std::vector<std::string_view>& names) {
+            if (kind == "type" && !names.empty()) {
+                cell.bus_types[std::string(names.front())] = busType();
+                return true;
+            }
+            if (kind != "pin" && kind != "bus" && kind != "bundle" && kind != "pg_pin") {
+                return false;
+            }
+            CellPin pin;
+            pin.names = names;
+            pin.kind = kind;
+            body([&](std::string_view attribute, std::string_view value) {
+                if (attribute == "direction") {
+                    pin.direction = (value == "input") ? IN : (value == "output") ? OUT : INOUT;
+                } else if (attribute == "clock") {
+                    pin.clock = value == "true";
+                } else if (attribute == "bus_type") {
+                    pin.bus_type = value;
+                } else if (attribute == "pg_type") {
+                    pin.pg_type = value;
+                }
+            }, [](std::string_view, const std::vector<std::string_view>&) {
+                return false;
+            });
+            cell.pins.push_back(std::move(pin));
+            return true;
+        });
+        release(fn);
+    }
+public:
+    // Calls fn(Symbol&&) for each cell as soon as its group has been read;
+    // fn returns false to stop. Throws std::runtime_error on malformed input.
+    template <typename Fn>
+    void parse(std::string_view _text, Fn fn) {
+        text = _text;
+        offset = 0;
+        line = 1;
+        bus_types.clear();
+        waiting.clear();
+        auto ignore = [](std::string_view, std::string_view) { };
+        try {
+            body(ignore, [&](std::string_view kind, const std::vector<std::string_view>&) {
+                if (kind != "library") {
+                    return false;
+                }
+                body(ignore, [&](std::string_view kind, const std::vector<std::string_view>& names) {
+                    if (kind == "cell" && !names.empty()) {
+                        cell(names.front(), fn);
+                    } else if (kind == "type" && !names.empty()) {
+                        bus_types[std::string(names.front())] = busType();
+                        release(fn);
+                    } else {
+                        return false;
+                    }
+                    return true;
+                });
+                // Types still unknown at the end of the library are shown by name
+                release(fn, true);
+                return true;
+            }, true);
+        } catch (const Stop&) {
+        }
+    }
+};
+
+// Parses a Liberty file on a worker thread and hands its cells over as they
+// complete, so whatever renders them overlaps with the parsing of the rest
+// of the file. At most kQueueLimit cells wait to be taken.
+class LibertyReader {
+    static constexpr size_t kQueueLimit = 256;
+
+    MappedFile file;
+    double max_name_width;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Symbol> ready;
+    bool done = false, stopped = false;
+    std::exception_ptr error;
+    std::thread worker;
+
+    void run() {
+        try {
+            TraceSpan span("parse", "parse");
+            LibertyParser().parse(file.text(), [this](Symbol&& symbol) {
+                // Measured here as well, so layout overlaps rendering too
+                symbol.setMaxNameWidth(max_name_width);
+                symbol.width();
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return stopped || ready.size() < kQueueLimit; });
+                if (stopped) {
+                    return false;
+                }
+                ready.push_back(std::move(symbol));
+                changed.notify_all();
+                return true;
+            });
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        changed.notify_all();
+    }
+public:
+    // Cells are laid out with pin names limited to max_name_width, see
+    // Pin::setMaxNameWidth
+    LibertyReader(const std::string& filename, double _max_name_width = 0) :
+        file(filename), max_name_width(_max_name_width), worker(&LibertyReader::run, this) { }
+
+    ~LibertyReader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+            changed.notify_all();
+        }
+        worker.join();
+    }
+
+    LibertyReader(const LibertyReader&) = delete;
+    LibertyReader& operator=(const LibertyReader&) = delete;
+
+    // The next cell in file order, waiting for it if need be, or nothing at
+    // the end; rethrows the parse error where the file went wrong
+    std::optional<Symbol> next() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return done || !ready.empty(); });
+        if (ready.empty()) {
+            if (error) {
+                std::rethrow_exception(std::exchange(error, nullptr));
+            }
+            return std::nullopt;
+        }
+        std::optional<Symbol> symbol(std::move(ready.front()));
+        ready.pop_front();
+        changed.notify_all();
+        return symbol;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Read-only mapping of a whole source file, so front-ends scan the text in
+// place instead of copying it into a string first. Pages are read ahead
+// sequentially, the way the parsers walk them.
+class MappedFile {
+    void* data = MAP_FAILED;
+    size_t size = 0;
+public:
+    MappedFile(const std::string& filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("could not open " + filename);
+        }
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if (ok && st.st_size > 0) {
+            size = st.st_size;
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = data != MAP_FAILED;
+        }
+        close(fd);
+        if (!ok) {
+            throw std::runtime_error("could not map " + filename);
+        }
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+        }
+    }
+
+    ~MappedFile() {
+        if (data != MAP_FAILED) {
+            munmap(data, size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Empty for an empty file
+    std::string_view text() const {
+        return (data == MAP_FAILED) ? std::string_view() : std::string_view(static_cast<const char*>(data), size);
+    }
+};
+
+#endif
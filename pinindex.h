@@ -0,0 +1,192 @@
+#ifndef PININDEX_H
+#define PININDEX_H
+
+#include <vector>
+#include "cairo-symbol.h"
+
+// Hit-testing index over the pins of a laid out symbol, in the coordinates
+// Symbol::draw uses. Each pin is covered by its Pin::bounds box (type, stem
+// and name). Pins of a section are kept in the order forEachPin places them,
+// one column per edge, and sections are stacked vertically, so both levels
+// are searched by binary search on y instead of a general R-tree.
+//
+// The index keeps a reference to the symbol. After pins of a section change,
+// or a section is added, updateSection() re-measures just that section
+// unless the symbol's frame width changed with it.
+class PinIndex {
+public:
+    // Pin is the index into the section's pins, as for Section::getPin, and
+    // pos the position Section::draw passes to Pin::draw
+    struct Hit {
+        size_t section;
+        size_t pin;
+        Cairo::Rectangle box, pos;
+    };
+private:
+    struct Entry {
+        Cairo::Rectangle box;
+        size_t item;
+        Cairo::Rectangle pos;
+    };
+
+    // Boxes in placement order, with a running maximum of their bottoms and a
+    // reverse running minimum of their tops for finding the overlapping range
+    struct Column {
+        std::vector<Entry> entries;
+        std::vector<double> max_bottom, min_top;
+
+        void finish() {
+            max_bottom.resize(entries.size());
+            min_top.resize(entries.size());
+            for (size_t i = 0; i < entries.size(); i++) {
+                const auto& box = entries[i].box;
+                max_bottom[i] = std::max(i ? max_bottom[i-1] : box.y+box.height, box.y+box.height);
+            }
+            for (size_t i = entries.size(); i-- > 0; ) {
+                const auto& box = entries[i].box;
+                min_top[i] = std::min(i+1 < entries.size() ? min_top[i+1] : box.y, box.y);
+            }
+        }
+
+        // Calls fn(entry) for every entry whose box overlaps [top, bottom] vertically
+        template <typename Fn>
+        void overlapping(double top, double bottom, Fn fn) const {
+            size_t i = std::lower_bound(max_bottom.begin(), max_bottom.end(), top)-max_bottom.begin();
+            for (; i < entries.size() && min_top[i] <= bottom; i++) {
+                const auto& box = entries[i].box;
+                if (box.y <= bottom && box.y+box.height >= top) {
+                    fn(entries[i]);
+                }
+            }
+        }
+    };
+
+    // Pin boxes and their union relative to the section's top left corner
+    struct SectionPins {
+        Column left, right;
+        Cairo::Rectangle bounds;
+        double top = 0, height = 0;
+    };
+
+    const Symbol& symbol;
+    Cairo::Rectangle frame;
+    std::vector<SectionPins> sections;
+    // Sections by their pins' union box, in symbol coordinates
+    Column section_boxes;
+
+    static bool intersects(const Cairo::Rectangle& a, const Cairo::Rectangle& b) {
+        return a.x <= b.x+b.width && b.x <= a.x+a.width && a.y <= b.y+b.height && b.y <= a.y+a.height;
+    }
+
+    void measureSection(size_t index) {
+        const Section& section = symbol.getSection(index);
+        SectionPins& entry = sections[index];
+        entry = SectionPins();
+        entry.height = section.height();
+        if (section.pinCount() == 0) {
+            return;
+        }
+        Cairo::Rectangle pos = { 0, 0, frame.width, entry.height };
+        double left = std::numeric_limits<double>::max(), top = left;
+        double right = std::numeric_limits<double>::lowest(), bottom = right;
+        section.forEachPin(pos, [&](const Pin& pin, const Cairo::Rectangle& pin_rect) {
+            Cairo::Rectangle box = Pin::bounds(pin_rect, pin.getDirection(), pin.nameRun().extents, pin.typeRun().extents);
+            Column& column = (pin.getDirection() == IN) ? entry.left : entry.right;
+            column.entries.push_back({ box, size_t(&pin-&section.getPin(0)), pin_rect });
+            left = std::min(left, box.x);
+            top = std::min(top, box.y);
+            right = std::max(right, box.x+box.width);
+            bottom = std::max(bottom, box.y+box.height);
+        });
+        entry.bounds = { left, top, right-left, bottom-top };
+        entry.left.finish();
+        entry.right.finish();
+    }
+
+    void placeSections() {
+        section_boxes = Column();
+        double y = frame.y;
+        for (size_t i = 0; i < sections.size(); i++) {
+            SectionPins& section = sections[i];
+            section.top = y;
+            if (!section.left.entries.empty() || !section.right.entries.empty()) {
+                const auto& bounds = section.bounds;
+                section_boxes.entries.push_back({ { frame.x+bounds.x, y+bounds.y, bounds.width, bounds.height }, i, Cairo::Rectangle() });
+            }
+            y += section.height;
+        }
+        section_boxes.finish();
+    }
+
+    // Calls fn(hit) for every pin whose box overlaps area
+    template <typename Fn>
+    void forEachHit(const Cairo::Rectangle& area, Fn fn) const {
+        section_boxes.overlapping(area.y, area.y+area.height, [&](const Entry& section) {
+            if (!intersects(section.box, area)) {
+                return;
+            }
+            double x = frame.x, y = sections[section.item].top;
+            Cairo::Rectangle local = { area.x-x, area.y-y, area.width, area.height };
+            const SectionPins& pins = sections[section.item];
+            for (const Column* column: { &pins.left, &pins.right }) {
+                column->overlapping(local.y, local.y+local.height, [&](const Entry& pin) {
+                    if (intersects(pin.box, local)) {
+                        Cairo::Rectangle box = { pin.box.x+x, pin.box.y+y, pin.box.width, pin.box.height };
+                        Cairo::Rectangle pos = { pin.pos.x+x, pin.pos.y+y, pin.pos.width, pin.pos.height };
+                        fn(Hit { section.item, pin.item, box, pos });
+                    }
+                });
+            }
+        });
+    }
+public:
+    PinIndex(const Symbol& _symbol) : symbol(_symbol) {
+        rebuild();
+    }
+
+    void rebuild() {
+        frame = symbol.frame();
+        sections.assign(symbol.sectionCount(), SectionPins());
+        for (size_t i = 0; i < sections.size(); i++) {
+            measureSection(i);
+        }
+        placeSections();
+    }
+
+    // Re-measures one changed or newly added section
+    void updateSection(size_t index) {
+        Cairo::Rectangle new_frame = symbol.frame();
+        if (new_frame.width != frame.width || symbol.sectionCount() < sections.size()) {
+            // Right hand pins moved with the frame's right edge
+            rebuild();
+            return;
+        }
+        frame = new_frame;
+        sections.resize(symbol.sectionCount());
+        measureSection(index);
+        placeSections();
+    }
+
+    // Pin under the point, if any
+    bool pinAt(double x, double y, Hit& hit) const {
+        bool found = false;
+        forEachHit({ x, y, 0, 0 }, [&](const Hit& h) {
+            if (!found) {
+                hit = h;
+                found = true;
+            }
+        });
+        return found;
+    }
+
+    // Pins whose boxes overlap area, as for a rubber band selection
+    std::vector<Hit> pinsIn(const Cairo::Rectangle& area) const {
+        std::vector<Hit> hits;
+        forEachHit(area, [&](const Hit& hit) {
+            hits.push_back(hit);
+        });
+        return hits;
+    }
+};
+
+#endif
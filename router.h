@@ -0,0 +1,287 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "cairo-symbol.h"
+
+// Orthogonal wire router: A* over a grid of kGrid units between pin stem
+// ends, around rectangular obstacles such as symbol frames. Obstacles are
+// rasterized once into a spatial hash of cell buckets, so empty space costs
+// nothing and a search only touches the buckets it passes through. Wires do
+// not block each other, which makes every connection independent: they are
+// routed in parallel, with search buffers kept per thread and reused across
+// connections. Buffers grow with the search window, so windows above
+// kMaxThreadCells borrow one of kLargeBuffers shared buffers instead; memory
+// then stays bounded however many threads route.
+class WireRouter {
+public:
+    struct Point {
+        double x, y;
+    };
+private:
+    static constexpr double kGrid = 5;
+    static constexpr int kBucket = 32;
+    // Search window margin around the two ends, in cells, and how often it may double
+    static constexpr int kMargin = 16;
+    static constexpr int kRetries = 3;
+    // Larger windows are not searched, the wire takes the fallback route
+    static constexpr long kMaxCells = 1 << 20;
+    // Each cell holds 4 states of 9 bytes: about 0.6 MB a thread for the
+    // windows searched with thread buffers, 36 MB for each shared one
+    static constexpr long kMaxThreadCells = 1 << 14;
+    static constexpr int kLargeBuffers = 2;
+    // A bend costs as much as this many cells of wire
+    static constexpr int kBendCost = 4;
+
+    // Blocked cells of each kBucket square of cells that any obstacle touches
+    std::unordered_map<uint64_t, std::bitset<kBucket*kBucket>> buckets;
+
+    struct Window {
+        int x, y, width, height;
+
+        bool contains(int cx, int cy) const {
+            return cx >= x && cy >= y && cx < x+width && cy < y+height;
+        }
+
+        size_t index(int cx, int cy) const {
+            return size_t(cy-y)*width+(cx-x);
+        }
+    };
+
+    // Open states by lowest estimate, the furthest along first among equal ones
+    struct Open {
+        int estimate, cost, state;
+
+        bool operator<(const Open& other) const {
+            return estimate != other.estimate ? estimate > other.estimate : cost < other.cost;
+        }
+    };
+
+    // Per thread: cost of each (cell, direction) state and the direction of the
+    // state it was reached from, valid where their stamp matches the current
+    // search, so nothing is cleared between searches
+    struct Buffers {
+        std::vector<int> cost;
+        std::vector<int8_t> from;
+        std::vector<uint32_t> stamp;
+        uint32_t search = 0;
+        std::vector<Open> open;
+    };
+
+    // Buffers for windows too large for the thread's own, lent out one
+    // search at a time
+    class LargeBuffers {
+        std::mutex mutex;
+        std::condition_variable returned;
+        std::vector<std::unique_ptr<Buffers>> available;
+    public:
+        LargeBuffers() {
+            for (int i = 0; i < kLargeBuffers; i++) {
+                available.emplace_back(new Buffers());
+            }
+        }
+
+        std::unique_ptr<Buffers> borrow() {
+            std::unique_lock<std::mutex> lock(mutex);
+            returned.wait(lock, [this] { return !available.empty(); });
+            std::unique_ptr<Buffers> buffers = std::move(available.back());
+            available.pop_back();
+            return buffers;
+        }
+
+        void giveBack(std::unique_ptr<Buffers> buffers) {
+            std::lock_guard<std::mutex> lock(mutex);
+            available.push_back(std::move(buffers));
+            returned.notify_one();
+        }
+    };
+    mutable LargeBuffers large_buffers;
+
+    static int cell(double coordinate) {
+        return std::lround(coordinate/kGrid);
+    }
+
+    static uint64_t bucketKey(int bx, int by) {
+        return (uint64_t(uint32_t(bx)) << 32) | uint32_t(by);
+    }
+
+    static int bucketOf(int cell) {
+        return (cell >= 0) ? cell/kBucket : -((-cell+kBucket-1)/kBucket);
+    }
+
+    bool blocked(int cx, int cy) const {
+        int bx = bucketOf(cx), by = bucketOf(cy);
+        auto it = buckets.find(bucketKey(bx, by));
+        return it != buckets.end() && it->second.test((cy-by*kBucket)*kBucket+(cx-bx*kBucket));
+    }
+
+    // Cells of the cheapest path from (sx, sy) to (gx, gy) inside window, or
+    // nothing; clipped tells whether the window's edge was in the way
+    std::vector<std::pair<int, int>> search(const Window& window, int sx, int sy, int gx, int gy, Buffers& buffers, bool& clipped) const {
+        static const int dx[4] = { 1, 0, -1, 0 }, dy[4] = { 0, 1, 0, -1 };
+        size_t states = size_t(window.width)*window.height*4;
+        if (buffers.cost.size() < states) {
+            buffers.cost.resize(states);
+            buffers.from.resize(states);
+            buffers.stamp.assign(states, 0);
+            buffers.search = 0;
+        }
+        if (++buffers.search == 0) {
+            std::fill(buffers.stamp.begin(), buffers.stamp.end(), 0);
+            buffers.search = 1;
+        }
+
+        // Manhattan distance plus the bends still needed heading in direction d
+        auto heuristic = [&](int cx, int cy, int d) {
+            int ex = gx-cx, ey = gy-cy;
+            bool ahead = (dx[d] && dx[d]*ex > 0) || (dy[d] && dy[d]*ey > 0);
+            bool behind = (dx[d] && dx[d]*ex < 0) || (dy[d] && dy[d]*ey < 0);
+            int bends = 0;
+            if (ex && ey) {
+                bends = ahead ? 1 : 2;
+            } else if (ex || ey) {
+                bends = ahead ? 0 : (behind ? 2 : 1);
+            }
+            return std::abs(ex)+std::abs(ey)+bends*kBendCost;
+        };
+        auto& open = buffers.open;
+        open.clear();
+        clipped = false;
+        auto push = [&](int state, int cost, int from) {
+            if (buffers.stamp[state] == buffers.search && buffers.cost[state] <= cost) {
+                return;
+            }
+            buffers.stamp[state] = buffers.search;
+            buffers.cost[state] = cost;
+            buffers.from[state] = from;
+            int c = state/4;
+            open.push_back({ cost+heuristic(window.x+c%window.width, window.y+c/window.width, state%4), cost, state });
+            std::push_heap(open.begin(), open.end());
+        };
+        for (int d = 0; d < 4; d++) {
+            push(window.index(sx, sy)*4+d, 0, -1);
+        }
+        while (!open.empty()) {
+            std::pop_heap(open.begin(), open.end());
+            Open next = open.back();
+            open.pop_back();
+            int state = next.state, cost = next.cost;
+            if (cost != buffers.cost[state]) {
+                // Stale entry, a cheaper one was pushed since
+                continue;
+            }
+            int c = state/4, d = state%4;
+            int cx = window.x+c%window.width, cy = window.y+c/window.width;
+            if (cx == gx && cy == gy) {
+                std::vector<std::pair<int, int>> path;
+                for (int s = state; ; ) {
+                    path.push_back({ cx, cy });
+                    if (buffers.from[s] < 0) {
+                        break;
+                    }
+                    cx -= dx[s%4];
+                    cy -= dy[s%4];
+                    s = window.index(cx, cy)*4+buffers.from[s];
+                }
+                std::reverse(path.begin(), path.end());
+                return path;
+            }
+            for (int nd = 0; nd < 4; nd++) {
+                if (nd == (d+2)%4) {
+                    continue;
+                }
+                int nx = cx+dx[nd], ny = cy+dy[nd];
+                if (!window.contains(nx, ny)) {
+                    clipped = true;
+                    continue;
+                }
+                if (blocked(nx, ny) && !(nx == gx && ny == gy)) {
+                    continue;
+                }
+                push(window.index(nx, ny)*4+nd, cost+1+(nd != d ? kBendCost : 0), d);
+            }
+        }
+        return {};
+    }
+
+    std::vector<Point> route(const Point& from, const Point& to, Buffers& buffers) const {
+        int sx = cell(from.x), sy = cell(from.y), gx = cell(to.x), gy = cell(to.y);
+        std::vector<std::pair<int, int>> path;
+        bool clipped = true;
+        for (int margin = kMargin, attempt = 0; path.empty() && clipped && attempt <= kRetries; margin *= 2, attempt++) {
+            Window window = { std::min(sx, gx)-margin, std::min(sy, gy)-margin, 0, 0 };
+            window.width = std::abs(sx-gx)+2*margin+1;
+            window.height = std::abs(sy-gy)+2*margin+1;
+            if (long(window.width)*window.height > kMaxCells) {
+                break;
+            }
+            if (long(window.width)*window.height <= kMaxThreadCells) {
+                path = search(window, sx, sy, gx, gy, buffers, clipped);
+            } else {
+                std::unique_ptr<Buffers> shared = large_buffers.borrow();
+                path = search(window, sx, sy, gx, gy, *shared, clipped);
+                large_buffers.giveBack(std::move(shared));
+            }
+        }
+
+        // Exact ends, short jogs onto the grid and the corners in between
+        std::vector<Point> points = { from };
+        auto add = [&](double x, double y) {
+            if (points.size() >= 2) {
+                const Point& a = points[points.size()-2];
+                Point& b = points.back();
+                if ((a.x == b.x && b.x == x) || (a.y == b.y && b.y == y)) {
+                    b = { x, y };
+                    return;
+                }
+            }
+            if (points.back().x != x || points.back().y != y) {
+                points.push_back({ x, y });
+            }
+        };
+        if (path.empty()) {
+            // No way around the obstacles: fall back to a plain three segment wire
+            double middle = (from.x+to.x)/2;
+            add(middle, from.y);
+            add(middle, to.y);
+        } else {
+            add(path.front().first*kGrid, from.y);
+            for (const auto& c: path) {
+                add(c.first*kGrid, c.second*kGrid);
+            }
+            add(path.back().first*kGrid, to.y);
+        }
+        add(to.x, to.y);
+        return points;
+    }
+public:
+    void addObstacle(const Cairo::Rectangle& box) {
+        int x1 = cell(box.x), x2 = cell(box.x+box.width), y1 = cell(box.y), y2 = cell(box.y+box.height);
+        for (int cy = y1; cy <= y2; cy++) {
+            for (int cx = x1; cx <= x2; cx++) {
+                int bx = bucketOf(cx), by = bucketOf(cy);
+                buckets[bucketKey(bx, by)].set((cy-by*kBucket)*kBucket+(cx-bx*kBucket));
+            }
+        }
+    }
+
+    // One orthogonal polyline per connection, from its first to its second point
+    std::vector<std::vector<Point>> route(const std::vector<std::pair<Point, Point>>& connections) const {
+        std::vector<std::vector<Point>> wires(connections.size());
+        parallelFor(connections.size(), [&](int i) {
+            thread_local Buffers buffers;
+            wires[i] = route(connections[i].first, connections[i].second, buffers);
+        });
+        return wires;
+    }
+};
+
+#endif
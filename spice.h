@@ -0,0 +1,177 @@
+#ifndef SPICE_H
+#define SPICE_H
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "cairo-symbol.h"
+
+// SPICE and CDL subcircuits as symbols, one per ".subckt name port ..."
+// header with its "+" continuation lines. The netlist is walked a line at a
+// time and only headers are tokenized: device and instance lines, which are
+// nearly all of a large netlist, are passed over by looking at their first
+// character. Netlists carry no port directions, so these come from a sidecar
+// file of "subckt port direction" lines, "*" as the subckt standing for
+// every one; ports it doesn't mention are drawn as inout.
+class SpiceImporter {
+    std::string_view text;
+    size_t offset = 0;
+    int line = 0;
+    // Per subckt, then for "*"; keyed "subckt port" in lower case
+    std::unordered_map<std::string, PinDirection> directions;
+
+    // SPICE names are case insensitive
+    static std::string lower(std::string_view word) {
+        std::string result(word);
+        for (auto& c: result) {
+            c = std::tolower((unsigned char)c);
+        }
+        return result;
+    }
+
+    static bool startsWithIgnoringCase(std::string_view text, std::string_view prefix) {
+        if (text.size() < prefix.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < prefix.size(); i++) {
+            if (std::tolower((unsigned char)text[i]) != prefix[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string_view trimStart(std::string_view text) {
+        size_t first = text.find_first_not_of(" \t");
+        return (first == std::string_view::npos) ? std::string_view() : text.substr(first);
+    }
+
+    // The next physical line without its end of line, or false at the end
+    bool nextLine(std::string_view& result) {
+        if (offset >= text.size()) {
+            return false;
+        }
+        const void* newline = std::memchr(text.data()+offset, '\n', text.size()-offset);
+        size_t end = newline ? static_cast<const char*>(newline)-text.data() : text.size();
+        result = text.substr(offset, end-offset);
+        if (!result.empty() && result.back() == '\r') {
+            result.remove_suffix(1);
+        }
+        offset = end+1;
+        line++;
+        return true;
+    }
+
+    // Appends the words of a header line up to any inline comment
+    static void words(std::string_view text, std::vector<std::string_view>& result) {
+        for (size_t i = 0; i < text.size(); ) {
+            while (i < text.size() && std::isspace((unsigned char)text[i])) {
+                i++;
+            }
+            if (i >= text.size() || text[i] == '$' || text[i] == ';') {
+                return;
+            }
+            size_t start = i;
+            while (i < text.size() && !std::isspace((unsigned char)text[i])) {
+                i++;
+            }
+            result.push_back(text.substr(start, i-start));
+        }
+    }
+
+    PinDirection direction(const std::string& subckt, std::string_view port) const {
+        std::string name = lower(port);
+        auto it = directions.find(subckt + " " + name);
+        if (it == directions.end()) {
+            it = directions.find("* " + name);
+        }
+        return (it == directions.end()) ? INOUT : it->second;
+    }
+public:
+    // Reads a sidecar of "subckt port in|out|inout" lines; "#" starts a
+    // comment line. Throws std::runtime_error on a malformed line.
+    void readDirections(std::string_view sidecar) {
+        text = sidecar;
+        offset = 0;
+        line = 0;
+        std::string_view current;
+        std::vector<std::string_view> fields;
+        while (nextLine(current)) {
+            current = trimStart(current);
+            if (current.empty() || current[0] == '#') {
+                continue;
+            }
+            fields.clear();
+            words(current, fields);
+            PinDirection direction;
+            std::string mode = fields.size() == 3 ? lower(fields[2]) : "";
+            if (mode == "in" || mode == "input") {
+                direction = IN;
+            } else if (mode == "out" || mode == "output") {
+                direction = OUT;
+            } else if (mode == "inout") {
+                direction = INOUT;
+            } else {
+                throw std::runtime_error("line " + std::to_string(line) + ": expected \"subckt port in|out|inout\"");
+            }
+            directions[lower(fields[0]) + " " + lower(fields[1])] = direction;
+        }
+    }
+
+    // Adds a symbol per subcircuit to the library and returns how many;
+    // throws std::runtime_error on a header without a name
+    size_t import(SymbolLibrary& library, std::string_view netlist) {
+        text = netlist;
+        offset = 0;
+        line = 0;
+        size_t count = 0;
+        std::string_view current;
+        std::vector<std::string_view> header;
+        bool pending = nextLine(current);
+        while (pending) {
+            std::string_view statement = trimStart(current);
+            if (!startsWithIgnoringCase(statement, ".subckt") ||
+                (statement.size() > 7 && !std::isspace((unsigned char)statement[7]))) {
+                pending = nextLine(current);
+                continue;
+            }
+            int header_line = line;
+            header.clear();
+            words(statement.substr(7), header);
+            while ((pending = nextLine(current))) {
+                std::string_view continuation = trimStart(current);
+                if (continuation.empty() || continuation[0] == '*') {
+                    // Blank and comment lines may sit inside a continued header
+                    continue;
+                }
+                if (continuation[0] != '+') {
+                    break;
+                }
+                words(continuation.substr(1), header);
+            }
+            if (header.empty()) {
+                throw std::runtime_error("line " + std::to_string(header_line) + ": .subckt without a name");
+            }
+
+            Symbol& symbol = library.emplaceSymbol(header[0]);
+            Section& section = symbol.emplaceSection();
+            std::string subckt = lower(header[0]);
+            for (size_t i = 1; i < header.size(); i++) {
+                // Parameters, "params:" or "name=value", end the port list
+                std::string_view port = header[i];
+                if (startsWithIgnoringCase(port, "params:") || port.find('=') != std::string_view::npos) {
+                    break;
+                }
+                section.emplacePin(port, direction(subckt, port), false, "");
+            }
+            count++;
+        }
+        return count;
+    }
+};
+
+#endif
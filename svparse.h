@@ -0,0 +1,980 @@
+#ifndef SVPARSE_H
+#define SVPARSE_H
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cairo-symbol.h"
+
+// Just enough of SystemVerilog to draw symbols and block diagrams: module
+// headers with ANSI or non-ANSI port lists, and the module instances in
+// their bodies. Everything else in a module body is skipped.
+//
+// Packed dimensions of port types are written out as numbers where their
+// bounds are constant expressions of parameters, localparams and `define
+// macros, so "logic [W-1:0]" reads "logic [7:0]". One parser is one
+// compilation unit: macros, packages and unit scope parameters carry over
+// from one parse() to the next, and each named constant is evaluated once,
+// on first use, however many ports refer to it.
+
+struct SvPort {
+    std::string name;
+    PinDirection direction;
+    std::string type;
+    bool is_bus;
+};
+
+// A connection is by name (.port(net), .port), by position (port empty) or
+// the .* wildcard (port "*")
+struct SvConnection {
+    std::string port;
+    std::string net;
+};
+
+struct SvInstance {
+    std::string module;
+    std::string name;
+    std::vector<SvConnection> connections;
+};
+
+struct SvModule {
+    std::string name;
+    std::vector<SvPort> ports;
+    std::vector<SvInstance> instances;
+};
+
+class SvParser {
+    enum TokenKind {
+        IDENTIFIER,
+        NUMBER,
+        STRING,
+        SYMBOL,
+        END
+    };
+
+    struct Token {
+        TokenKind kind;
+        std::string_view text;
+        int line;
+    };
+
+    // A parameter's expression, macros already expanded, and its value once known
+    struct Constant {
+        std::string expression;
+        std::string scope;
+        enum { PENDING, EVALUATING, DONE } state = PENDING;
+        bool known = false;
+        long long value = 0;
+    };
+
+    // Position in the tokens of one constant expression
+    struct Cursor {
+        const Token* at;
+        const Token* end;
+        const std::string& scope;
+    };
+
+    static constexpr int kMacroDepth = 16;
+    static inline const std::string kUnit = "$unit";
+
+    std::vector<Token> tokens;
+    size_t pos = 0;
+    // Compilation unit state. Constants are keyed "scope::name", where the
+    // scope is "$unit", a package name or "module name"; imports are
+    // "package::*" or "package::name" per scope.
+    std::unordered_map<std::string, std::string> macros;
+    std::unordered_map<std::string, Constant> constants;
+    std::unordered_map<std::string, std::vector<std::string>> imports;
+    std::string scope = kUnit;
+
+    static bool isIdentifierStart(char c) {
+        return std::isalpha((unsigned char)c) || c == '_' || c == '$';
+    }
+
+    static bool isIdentifierChar(char c) {
+        return std::isalnum((unsigned char)c) || c == '_' || c == '$';
+    }
+
+    static bool isKeyword(std::string_view word) {
+        static const std::unordered_set<std::string_view> keywords = {
+            "always", "always_comb", "always_ff", "always_latch", "and", "assert", "assign", "assume",
+            "automatic", "begin", "bit", "buf", "byte", "case", "casex", "casez", "class", "const", "cover",
+            "default", "disable", "do", "else", "end", "endcase", "endclass", "endfunction", "endgenerate",
+            "endinterface", "endmodule", "endpackage", "endtask", "enum", "export", "extends", "final", "for",
+            "foreach", "forever", "fork", "function", "generate", "genvar", "if", "import", "initial", "inout",
+            "input", "int", "integer", "interface", "join", "join_any", "join_none", "localparam", "logic",
+            "longint", "modport", "module", "nand", "negedge", "nor", "not", "or", "output", "package",
+            "packed", "parameter", "posedge", "priority", "real", "ref", "reg", "repeat", "return",
+            "shortint", "signed", "static", "string", "struct", "supply0", "supply1", "task", "time", "tri",
+            "typedef", "union", "unique", "unsigned", "var", "virtual", "wait", "wand", "while", "wire",
+            "wor", "xnor", "xor"
+        };
+        return keywords.count(word) > 0;
+    }
+
+    static bool isMacro(const Token& token) {
+        return token.kind == IDENTIFIER && token.text[0] == '`';
+    }
+
+    // Compiler directives other than macro definitions and conditionals,
+    // which are skipped to the end of the line
+    static bool isDirective(std::string_view word) {
+        static const std::unordered_set<std::string_view> directives = {
+            "begin_keywords", "celldefine", "default_nettype", "end_keywords", "endcelldefine", "endprotect",
+            "include", "line", "nounconnected_drive", "pragma", "protect", "resetall", "timescale",
+            "unconnected_drive", "undefineall"
+        };
+        return directives.count(word) > 0;
+    }
+
+    // Appends the tokens of source to out. With directives, as for a source
+    // file, `define and `undef update the macros and `ifdef, `ifndef, `elsif,
+    // `else and `endif drop the tokens of branches not taken; otherwise, as
+    // for expression text, every `name is a macro use.
+    void tokenize(std::string_view source, std::vector<Token>& out, bool directives) {
+        int line = 1;
+        size_t i = 0;
+        // Per open `ifdef: whether its current branch is taken, and whether any was
+        std::vector<std::pair<bool, bool>> conditions;
+        bool active = true;
+        auto push = [&](TokenKind kind, std::string_view text) {
+            if (active) {
+                out.push_back({ kind, text, line });
+            }
+        };
+        auto word = [&]() {
+            while (i < source.size() && (source[i] == ' ' || source[i] == '\t')) {
+                i++;
+            }
+            size_t start = i;
+            while (i < source.size() && isIdentifierChar(source[i])) {
+                i++;
+            }
+            return source.substr(start, i-start);
+        };
+        while (i < source.size()) {
+            char c = source[i];
+            if (c == '\n') {
+                line++;
+                i++;
+            } else if (std::isspace((unsigned char)c)) {
+                i++;
+            } else if (source.compare(i, 2, "//") == 0) {
+                while (i < source.size() && source[i] != '\n') {
+                    i++;
+                }
+            } else if (c == '`' && directives) {
+                size_t start = i++;
+                std::string_view directive = word();
+                if (directive == "define") {
+                    std::string name(word());
+                    bool function = i < source.size() && source[i] == '(';
+                    // The body runs to the end of the line, continued by a trailing backslash
+                    size_t body = i;
+                    while (i < source.size() && source[i] != '\n') {
+                        line += source.compare(i, 2, "\\\n") == 0;
+                        i += (source.compare(i, 2, "\\\n") == 0) ? 2 : 1;
+                    }
+                    if (!active) {
+                        continue;
+                    }
+                    if (function) {
+                        // Macros with arguments are not expanded
+                        macros.erase(name);
+                    } else {
+                        std::string text(source.substr(body, i-body));
+                        for (size_t at; (at = text.find("\\\n")) != std::string::npos; ) {
+                            text.replace(at, 2, " ");
+                        }
+                        macros[name] = text;
+                    }
+                } else if (directive == "undef") {
+                    std::string name(word());
+                    if (active) {
+                        macros.erase(name);
+                    }
+                } else if (directive == "ifdef" || directive == "ifndef") {
+                    bool taken = (macros.count(std::string(word())) > 0) == (directive == "ifdef");
+                    conditions.push_back({ taken, taken });
+                } else if (directive == "elsif" && !conditions.empty()) {
+                    bool taken = !conditions.back().second && macros.count(std::string(word())) > 0;
+                    conditions.back() = { taken, conditions.back().second || taken };
+                } else if (directive == "else" && !conditions.empty()) {
+                    conditions.back() = { !conditions.back().second, true };
+                } else if (directive == "endif" && !conditions.empty()) {
+                    conditions.pop_back();
+                } else if (isDirective(directive)) {
+                    while (i < source.size() && source[i] != '\n') {
+                        i++;
+                    }
+                } else {
+                    push(IDENTIFIER, source.substr(start, i-start));
+                }
+                active = std::all_of(conditions.begin(), conditions.end(), [](const auto& condition) {
+                    return condition.first;
+                });
+            } else if (c == '`') {
+                size_t start = i++;
+                word();
+                push(IDENTIFIER, source.substr(start, i-start));
+            } else if (source.compare(i, 2, "/*") == 0) {
+                size_t end = source.find("*/", i+2);
+                end = (end == std::string_view::npos) ? source.size() : end+2;
+                for (; i < end; i++) {
+                    line += source[i] == '\n';
+                }
+            } else if (source.compare(i, 2, "(*") == 0 && source.compare(i, 3, "(*)") != 0) {
+                // Attribute instance
+                size_t end = source.find("*)", i+2);
+                end = (end == std::string_view::npos) ? source.size() : end+2;
+                for (; i < end; i++) {
+                    line += source[i] == '\n';
+                }
+            } else if (isIdentifierStart(c) || c == '\\') {
+                size_t start = i++;
+                if (c == '\\') {
+                    // Escaped identifiers end at white space
+                    while (i < source.size() && !std::isspace((unsigned char)source[i])) {
+                        i++;
+                    }
+                } else {
+                    while (i < source.size() && isIdentifierChar(source[i])) {
+                        i++;
+                    }
+                }
+                push(IDENTIFIER, source.substr(start, i-start));
+            } else if (std::isdigit((unsigned char)c) || (c == '\'' && i+1 < source.size() && std::isalnum((unsigned char)source[i+1]))) {
+                // Decimals and based literals such as 8'hff or 'b1
+                size_t start = i++;
+                while (i < source.size() && (isIdentifierChar(source[i]) || source[i] == '\'' || source[i] == '.')) {
+                    i++;
+                }
+                push(NUMBER, source.substr(start, i-start));
+            } else if (c == '"') {
+                size_t start = i++;
+                while (i < source.size() && source[i] != '"') {
+                    i += (source[i] == '\\') ? 2 : 1;
+                }
+                i = std::min(i+1, source.size());
+                push(STRING, source.substr(start, i-start));
+            } else {
+                push(SYMBOL, source.substr(i, 1));
+                i++;
+            }
+        }
+        out.push_back({ END, std::string_view(), line });
+    }
+
+    const Token& peek(size_t ahead = 0) const {
+        return tokens[std::min(pos+ahead, tokens.size()-1)];
+    }
+
+    bool at(std::string_view text, size_t ahead = 0) const {
+        const Token& token = peek(ahead);
+        return token.kind != END && token.kind != STRING && token.text == text;
+    }
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("line " + std::to_string(peek().line) + ": " + message);
+    }
+
+    void expect(std::string_view text) {
+        if (!at(text)) {
+            fail("expected '" + std::string(text) + "'");
+        }
+        pos++;
+    }
+
+    std::string_view identifier() {
+        if (peek().kind != IDENTIFIER || isKeyword(peek().text)) {
+            fail("expected an identifier");
+        }
+        return tokens[pos++].text;
+    }
+
+    // Index just past the bracket matching the one at index
+    size_t skipBalanced(size_t index) const {
+        int depth = 0;
+        for (; index < tokens.size()-1; index++) {
+            std::string_view text = tokens[index].text;
+            if (tokens[index].kind == SYMBOL && (text == "(" || text == "[" || text == "{")) {
+                depth++;
+            } else if (tokens[index].kind == SYMBOL && (text == ")" || text == "]" || text == "}")) {
+                if (--depth == 0) {
+                    return index+1;
+                }
+            }
+        }
+        return index;
+    }
+
+    // Source text of tokens [begin, end), with spaces only where words meet
+    std::string join(size_t begin, size_t end) const {
+        std::string text;
+        for (size_t i = begin; i < end; i++) {
+            bool word = tokens[i].kind != SYMBOL;
+            if (i > begin && ((word && tokens[i-1].kind != SYMBOL) || (tokens[i].text == "[" && tokens[i-1].kind != SYMBOL))) {
+                text += ' ';
+            }
+            text += tokens[i].text;
+        }
+        return text;
+    }
+
+    // Splits [begin, end) at top level commas
+    std::vector<std::pair<size_t, size_t>> splitList(size_t begin, size_t end) const {
+        std::vector<std::pair<size_t, size_t>> items;
+        size_t start = begin;
+        for (size_t i = begin; i < end; ) {
+            if (tokens[i].kind == SYMBOL && (tokens[i].text == "(" || tokens[i].text == "[" || tokens[i].text == "{")) {
+                i = skipBalanced(i);
+            } else if (tokens[i].kind == SYMBOL && tokens[i].text == ",") {
+                items.push_back({ start, i });
+                start = ++i;
+            } else {
+                i++;
+            }
+        }
+        if (start < end) {
+            items.push_back({ start, end });
+        }
+        return items;
+    }
+
+    // Token text with every macro use replaced by its body, expanded in turn.
+    // Tokens are kept apart by spaces, so the text tokenizes back the same.
+    std::string expand(const Token* begin, const Token* end, int depth = 0) {
+        std::string text;
+        for (const Token* token = begin; token < end; token++) {
+            auto macro = (isMacro(*token) && depth < kMacroDepth) ? macros.find(std::string(token->text.substr(1))) : macros.end();
+            if (macro != macros.end()) {
+                std::vector<Token> body;
+                tokenize(macro->second, body, false);
+                text += expand(body.data(), body.data()+body.size()-1, depth+1);
+            } else {
+                text += token->text;
+            }
+            text += ' ';
+        }
+        return text;
+    }
+
+    // Decimal and based literals; false for reals and for x and z digits
+    static bool number(std::string_view text, long long& value) {
+        std::string digits;
+        int base = 10;
+        size_t quote = text.find('\'');
+        if (quote != std::string_view::npos) {
+            size_t at = quote+1;
+            if (at < text.size() && (text[at] == 's' || text[at] == 'S')) {
+                at++;
+            }
+            if (at >= text.size()) {
+                return false;
+            }
+            switch (std::tolower((unsigned char)text[at])) {
+            case 'b': base = 2; break;
+            case 'o': base = 8; break;
+            case 'd': base = 10; break;
+            case 'h': base = 16; break;
+            case '0': value = 0; return at+1 == text.size();
+            default: return false;
+            }
+            text = text.substr(at+1);
+        }
+        for (char c: text) {
+            if (c != '_') {
+                digits += c;
+            }
+        }
+        if (digits.empty()) {
+            return false;
+        }
+        char* end;
+        errno = 0;
+        value = std::strtoll(digits.c_str(), &end, base);
+        return *end == '\0' && errno != ERANGE;
+    }
+
+    // The operator spelled by the symbol tokens at the cursor, or nothing
+    static std::string_view operatorAt(const Cursor& cursor) {
+        static const std::string_view operators[] = {
+            "<<<", ">>>", "**", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "::",
+            "+", "-", "*", "/", "%", "<", ">", "&", "|", "^", "?", ":", "!", "~"
+        };
+        for (auto op: operators) {
+            if (cursor.end-cursor.at < (ptrdiff_t)op.size()) {
+                continue;
+            }
+            size_t i = 0;
+            while (i < op.size() && cursor.at[i].kind == SYMBOL && cursor.at[i].text[0] == op[i]) {
+                i++;
+            }
+            if (i == op.size()) {
+                return op;
+            }
+        }
+        return std::string_view();
+    }
+
+    static int precedence(std::string_view op) {
+        static const std::pair<std::string_view, int> table[] = {
+            { "**", 11 }, { "*", 10 }, { "/", 10 }, { "%", 10 }, { "+", 9 }, { "-", 9 },
+            { "<<", 8 }, { ">>", 8 }, { "<<<", 8 }, { ">>>", 8 }, { "<", 7 }, { "<=", 7 }, { ">", 7 }, { ">=", 7 },
+            { "==", 6 }, { "!=", 6 }, { "&", 5 }, { "^", 4 }, { "|", 3 }, { "&&", 2 }, { "||", 1 }
+        };
+        for (const auto& entry: table) {
+            if (entry.first == op) {
+                return entry.second;
+            }
+        }
+        return 0;
+    }
+
+    // False where the result isn't defined or doesn't fit, which leaves the
+    // expression unevaluated
+    static bool apply(std::string_view op, long long left, long long right, long long& value) {
+        if (op == "**") {
+            if (right < 0 || right > 63) {
+                return false;
+            }
+            value = 1;
+            for (long long i = 0; i < right; i++) {
+                if (__builtin_mul_overflow(value, left, &value)) {
+                    return false;
+                }
+            }
+        } else if (op == "/" || op == "%") {
+            if (right == 0 || (right == -1 && left == std::numeric_limits<long long>::min())) {
+                return false;
+            }
+            value = (op == "/") ? left/right : left%right;
+        } else if (op == "<<" || op == "<<<" || op == ">>" || op == ">>>") {
+            if (right < 0 || right > 63) {
+                return false;
+            }
+            if (op[0] == '>') {
+                value = left >> right;
+            } else if (left < 0 || left > (std::numeric_limits<long long>::max() >> right)) {
+                return false;
+            } else {
+                value = left << right;
+            }
+        } else if (op == "*" || op == "+" || op == "-") {
+            bool overflow = (op == "*") ? __builtin_mul_overflow(left, right, &value) :
+                            (op == "+") ? __builtin_add_overflow(left, right, &value) :
+                                          __builtin_sub_overflow(left, right, &value);
+            if (overflow) {
+                return false;
+            }
+        } else {
+            value = (op == "<") ? left < right : (op == "<=") ? left <= right : (op == ">") ? left > right :
+                    (op == ">=") ? left >= right : (op == "==") ? left == right : (op == "!=") ? left != right :
+                    (op == "&") ? left & right : (op == "^") ? left ^ right : (op == "|") ? left | right :
+                    (op == "&&") ? left && right : left || right;
+        }
+        return true;
+    }
+
+    bool primary(Cursor& cursor, long long& value) {
+        if (cursor.at >= cursor.end) {
+            return false;
+        }
+        const Token& token = *cursor.at++;
+        if (token.kind == NUMBER) {
+            return number(token.text, value);
+        }
+        if (token.kind == SYMBOL && token.text == "(") {
+            if (!conditional(cursor, value) || cursor.at >= cursor.end || cursor.at->text != ")") {
+                return false;
+            }
+            cursor.at++;
+            return true;
+        }
+        if (token.kind != IDENTIFIER || isMacro(token)) {
+            return false;
+        }
+        if (token.text == "$clog2") {
+            long long argument;
+            if (!primary(cursor, argument)) {
+                return false;
+            }
+            for (value = 0; (1LL << value) < argument && value < 63; value++) {
+            }
+            return true;
+        }
+        if (operatorAt(cursor) == "::" && cursor.end-cursor.at > 2 && cursor.at[2].kind == IDENTIFIER) {
+            std::string key = std::string(token.text) + "::" + std::string(cursor.at[2].text);
+            cursor.at += 3;
+            return constant(key, value);
+        }
+        return lookup(cursor.scope, token.text, value);
+    }
+
+    bool unary(Cursor& cursor, long long& value) {
+        std::string_view op = operatorAt(cursor);
+        if (op != "+" && op != "-" && op != "!" && op != "~") {
+            return primary(cursor, value);
+        }
+        cursor.at++;
+        if (!unary(cursor, value)) {
+            return false;
+        }
+        if (op == "-" && value == std::numeric_limits<long long>::min()) {
+            return false;
+        }
+        value = (op == "-") ? -value : (op == "!") ? !value : (op == "~") ? ~value : value;
+        return true;
+    }
+
+    // Binary operators of at least the given precedence, all left associative
+    bool binary(Cursor& cursor, int lowest, long long& value) {
+        if (!unary(cursor, value)) {
+            return false;
+        }
+        while (true) {
+            std::string_view op = operatorAt(cursor);
+            int level = precedence(op);
+            if (level == 0 || level < lowest) {
+                return true;
+            }
+            cursor.at += op.size();
+            long long right;
+            if (!binary(cursor, level+1, right) || !apply(op, value, right, value)) {
+                return false;
+            }
+        }
+    }
+
+    bool conditional(Cursor& cursor, long long& value) {
+        if (!binary(cursor, 1, value)) {
+            return false;
+        }
+        if (operatorAt(cursor) != "?") {
+            return true;
+        }
+        cursor.at++;
+        long long yes, no;
+        if (!conditional(cursor, yes) || operatorAt(cursor) != ":") {
+            return false;
+        }
+        cursor.at++;
+        if (!conditional(cursor, no)) {
+            return false;
+        }
+        value = value ? yes : no;
+        return true;
+    }
+
+    // Runs fn(cursor) over [begin, end), after expanding any macros in it,
+    // and succeeds if fn does and uses up every token
+    template <typename Fn>
+    bool evaluate(const Token* begin, const Token* end, const std::string& in_scope, Fn fn) {
+        if (std::none_of(begin, end, isMacro)) {
+            Cursor cursor { begin, end, in_scope };
+            return fn(cursor) && cursor.at == cursor.end;
+        }
+        std::string text = expand(begin, end);
+        std::vector<Token> expanded;
+        tokenize(text, expanded, false);
+        Cursor cursor { expanded.data(), expanded.data()+expanded.size()-1, in_scope };
+        return fn(cursor) && cursor.at == cursor.end;
+    }
+
+    // The value of a named constant, evaluated on first use and kept
+    bool constant(const std::string& key, long long& value) {
+        auto it = constants.find(key);
+        if (it == constants.end() || it->second.state == Constant::EVALUATING) {
+            return false;
+        }
+        Constant& entry = it->second;
+        if (entry.state == Constant::PENDING) {
+            entry.state = Constant::EVALUATING;
+            std::vector<Token> expression;
+            tokenize(entry.expression, expression, false);
+            entry.known = evaluate(expression.data(), expression.data()+expression.size()-1, entry.scope, [&](Cursor& cursor) {
+                return conditional(cursor, entry.value);
+            });
+            entry.state = Constant::DONE;
+        }
+        value = entry.value;
+        return entry.known;
+    }
+
+    // A plain name as seen from a scope: its own constants, then what it
+    // imports, then the compilation unit's
+    bool lookup(const std::string& in_scope, std::string_view name, long long& value) {
+        std::string key = in_scope + "::" + std::string(name);
+        if (constants.count(key) > 0) {
+            return constant(key, value);
+        }
+        auto scope_imports = imports.find(in_scope);
+        if (scope_imports != imports.end()) {
+            for (const auto& import: scope_imports->second) {
+                size_t colons = import.find("::");
+                std::string_view item = std::string_view(import).substr(colons+2);
+                if (item == "*" || item == name) {
+                    key = import.substr(0, colons) + "::" + std::string(name);
+                    if (constants.count(key) > 0) {
+                        return constant(key, value);
+                    }
+                }
+            }
+        }
+        return in_scope != kUnit && lookup(kUnit, name, value);
+    }
+
+    // Type text of [begin, end) with each dimension whose bounds are constant
+    // written out in numbers; a bus when any dimension is wider than one bit
+    // or could not be worked out
+    std::string resolvedType(size_t begin, size_t end, bool& is_bus) {
+        std::string text;
+        is_bus = false;
+        for (size_t i = begin; i < end; ) {
+            bool bracket = tokens[i].kind == SYMBOL && tokens[i].text == "[";
+            size_t next = bracket ? std::min(skipBalanced(i), end) : i+1;
+            if (i > begin && (tokens[i].kind != SYMBOL || bracket) && tokens[i-1].kind != SYMBOL) {
+                text += ' ';
+            }
+            long long left = 0, right = 0;
+            bool range = false;
+            if (bracket && next-i > 2 && evaluate(&tokens[i+1], &tokens[next-1], scope, [&](Cursor& cursor) {
+                    if (!conditional(cursor, left)) {
+                        return false;
+                    }
+                    range = operatorAt(cursor) == ":";
+                    return !range || (cursor.at++, conditional(cursor, right));
+                })) {
+                text += "[" + std::to_string(left) + (range ? ":" + std::to_string(right) : "") + "]";
+                is_bus = is_bus || (range ? left != right : left > 1);
+            } else {
+                text += join(i, next);
+                is_bus = is_bus || bracket;
+            }
+            i = next;
+        }
+        return text;
+    }
+
+    // "[parameter|localparam] [type] name [dimensions] = value" in [begin, end)
+    // records the value's text for evaluation on first use; type parameters
+    // and parameters without a default are passed over
+    void parameter(size_t begin, size_t end) {
+        size_t name = end;
+        for (size_t i = begin; i < end; i++) {
+            if (tokens[i].kind == SYMBOL && tokens[i].text == "[") {
+                i = skipBalanced(i)-1;
+            } else if (tokens[i].kind == SYMBOL && tokens[i].text == "=") {
+                if (name != end) {
+                    Constant& entry = constants[scope + "::" + std::string(tokens[name].text)];
+                    entry = Constant();
+                    entry.expression = expand(&tokens[i+1], &tokens[end]);
+                    entry.scope = scope;
+                }
+                return;
+            } else if (tokens[i].text == "type") {
+                return;
+            } else if (tokens[i].kind == IDENTIFIER && !isKeyword(tokens[i].text)) {
+                name = i;
+            }
+        }
+    }
+
+    // Index of the ";" ending the statement at pos
+    size_t statementEnd() const {
+        size_t end = pos;
+        while (end < tokens.size()-1 && !(tokens[end].kind == SYMBOL && tokens[end].text == ";")) {
+            end++;
+        }
+        return end;
+    }
+
+    // "parameter|localparam ... ;" with one or more names
+    void parameterDeclaration() {
+        size_t end = statementEnd();
+        for (const auto& item: splitList(pos, end)) {
+            parameter(item.first, item.second);
+        }
+        pos = end+1;
+    }
+
+    // "import package::*, package::name ;"
+    void importDeclaration() {
+        size_t end = statementEnd();
+        for (const auto& item: splitList(pos+1, end)) {
+            if (item.second-item.first == 4 && tokens[item.first+1].text == ":" && tokens[item.first+2].text == ":") {
+                imports[scope].push_back(std::string(tokens[item.first].text) + "::" + std::string(tokens[item.first+3].text));
+            }
+        }
+        pos = end+1;
+    }
+
+    static bool directionOf(std::string_view word, PinDirection& direction) {
+        if (word == "input") {
+            direction = IN;
+        } else if (word == "output") {
+            direction = OUT;
+        } else if (word == "inout" || word == "ref") {
+            direction = INOUT;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // One declaration, "[direction] [type] name [unpacked dimensions] [= default]"
+    // in [begin, end). Direction and type carry over from the previous port
+    // when left out, as in "input logic a, b".
+    SvPort declaration(size_t begin, size_t end, const SvPort& previous) {
+        SvPort port = previous;
+        size_t i = begin;
+        bool has_direction = i < end && directionOf(tokens[i].text, port.direction);
+        if (has_direction) {
+            i++;
+        }
+        size_t name = end;
+        for (size_t j = i; j < end; j++) {
+            if (tokens[j].kind == SYMBOL && (tokens[j].text == "=" || (tokens[j].text == "[" && name != end))) {
+                break;
+            }
+            if (tokens[j].kind == SYMBOL && tokens[j].text == "[") {
+                j = skipBalanced(j)-1;
+            } else if (tokens[j].kind == IDENTIFIER && !isKeyword(tokens[j].text)) {
+                name = j;
+            }
+        }
+        if (name == end) {
+            throw std::runtime_error("line " + std::to_string(tokens[begin].line) + ": port without a name");
+        }
+        port.name = std::string(tokens[name].text);
+        if (i < name) {
+            port.type = resolvedType(i, name, port.is_bus);
+        } else if (has_direction) {
+            port.type = "logic";
+            port.is_bus = false;
+        }
+        return port;
+    }
+
+    void portList(SvModule& module, std::vector<std::string>& non_ansi) {
+        size_t end = skipBalanced(pos)-1;
+        SvPort previous = { "", INOUT, "logic", false };
+        auto items = splitList(pos+1, end);
+        bool ansi = false;
+        for (const auto& item: items) {
+            ansi = ansi || item.second-item.first > 1;
+        }
+        for (const auto& item: items) {
+            if (ansi) {
+                previous = declaration(item.first, item.second, previous);
+                module.ports.push_back(previous);
+            } else {
+                non_ansi.emplace_back(tokens[item.first].text);
+            }
+        }
+        pos = end+1;
+    }
+
+    // Non-ANSI "input [3:0] a, b;" in the module body
+    void portDeclaration(SvModule& module) {
+        size_t end = statementEnd();
+        SvPort previous = { "", INOUT, "logic", false };
+        for (const auto& item: splitList(pos, end)) {
+            previous = declaration(item.first, item.second, previous);
+            for (auto& port: module.ports) {
+                if (port.name == previous.name) {
+                    port = previous;
+                }
+            }
+        }
+        pos = end+1;
+    }
+
+    // "module_name [#(...)] name [dimensions] (connections) {, name (connections)} ;"
+    bool instances(SvModule& module) {
+        if (peek().kind != IDENTIFIER || isKeyword(peek().text)) {
+            return false;
+        }
+        size_t i = pos+1;
+        if (at("#", 1)) {
+            if (!at("(", 2)) {
+                return false;
+            }
+            i = skipBalanced(pos+2);
+        }
+        std::vector<SvInstance> found;
+        while (true) {
+            if (tokens[i].kind != IDENTIFIER || isKeyword(tokens[i].text)) {
+                return false;
+            }
+            SvInstance instance { std::string(tokens[pos].text), std::string(tokens[i].text), {} };
+            i++;
+            while (tokens[i].kind == SYMBOL && tokens[i].text == "[") {
+                i = skipBalanced(i);
+            }
+            if (!(tokens[i].kind == SYMBOL && tokens[i].text == "(")) {
+                return false;
+            }
+            size_t end = skipBalanced(i)-1;
+            for (const auto& item: splitList(i+1, end)) {
+                instance.connections.push_back(connection(item.first, item.second));
+            }
+            found.push_back(std::move(instance));
+            i = end+1;
+            if (tokens[i].kind == SYMBOL && tokens[i].text == ";") {
+                break;
+            }
+            if (!(tokens[i].kind == SYMBOL && tokens[i].text == ",")) {
+                return false;
+            }
+            i++;
+        }
+        for (auto& instance: found) {
+            module.instances.push_back(std::move(instance));
+        }
+        pos = i+1;
+        return true;
+    }
+
+    SvConnection connection(size_t begin, size_t end) const {
+        if (tokens[begin].text == "." && begin+1 < end && tokens[begin+1].text == "*") {
+            return { "*", "" };
+        }
+        if (tokens[begin].text == "." && begin+1 < end) {
+            std::string port(tokens[begin+1].text);
+            if (begin+2 >= end) {
+                // .port connects the net of the same name
+                return { port, port };
+            }
+            return { port, net(begin+3, end-1) };
+        }
+        return { "", net(begin, end) };
+    }
+
+    // A plain identifier, maybe with a bit or part select, connects that net;
+    // any other expression is kept as text and will not match other ends
+    std::string net(size_t begin, size_t end) const {
+        if (begin >= end) {
+            return "";
+        }
+        if (tokens[begin].kind == IDENTIFIER && (begin+1 == end || tokens[begin+1].text == "[")) {
+            return std::string(tokens[begin].text);
+        }
+        return join(begin, end);
+    }
+
+    void skipPast(std::string_view text) {
+        while (peek().kind != END && !at(text)) {
+            pos++;
+        }
+        pos++;
+    }
+
+    SvModule module() {
+        SvModule module;
+        module.name = std::string(identifier());
+        scope = "module " + module.name;
+        imports.erase(scope);
+        while (at("import")) {
+            importDeclaration();
+        }
+        if (at("#") && at("(", 1)) {
+            size_t end = skipBalanced(pos+1)-1;
+            for (const auto& item: splitList(pos+2, end)) {
+                parameter(item.first, item.second);
+            }
+            pos = end+1;
+        }
+        std::vector<std::string> non_ansi;
+        if (at("(")) {
+            portList(module, non_ansi);
+        }
+        expect(";");
+        for (const auto& name: non_ansi) {
+            module.ports.push_back({ name, INOUT, "logic", false });
+        }
+
+        while (peek().kind != END && !at("endmodule")) {
+            PinDirection direction;
+            if (peek().kind == IDENTIFIER && directionOf(peek().text, direction)) {
+                portDeclaration(module);
+            } else if (at("parameter") || at("localparam")) {
+                parameterDeclaration();
+            } else if (at("import")) {
+                importDeclaration();
+            } else if (at("function")) {
+                skipPast("endfunction");
+            } else if (at("task")) {
+                skipPast("endtask");
+            } else if (!instances(module)) {
+                pos++;
+            }
+        }
+        expect("endmodule");
+        scope = kUnit;
+        return module;
+    }
+
+    // Only the constants and imports of a package are kept
+    void package() {
+        scope = std::string(identifier());
+        imports.erase(scope);
+        while (peek().kind != END && !at("endpackage")) {
+            if (at("parameter") || at("localparam")) {
+                parameterDeclaration();
+            } else if (at("import")) {
+                importDeclaration();
+            } else if (at("class")) {
+                skipPast("endclass");
+            } else if (at("function")) {
+                skipPast("endfunction");
+            } else if (at("task")) {
+                skipPast("endtask");
+            } else {
+                pos++;
+            }
+        }
+        expect("endpackage");
+        scope = kUnit;
+    }
+public:
+    // Modules declared in source; throws std::runtime_error on malformed headers
+    std::vector<SvModule> parse(std::string_view source) {
+        tokens.clear();
+        pos = 0;
+        scope = kUnit;
+        tokenize(source, tokens, true);
+        std::vector<SvModule> modules;
+        while (peek().kind != END) {
+            if (at("module") || at("macromodule")) {
+                pos++;
+                modules.push_back(module());
+            } else if (at("package")) {
+                pos++;
+                package();
+            } else if (at("parameter") || at("localparam")) {
+                parameterDeclaration();
+            } else if (at("import")) {
+                importDeclaration();
+            } else if (at("interface") && !at("class", 1)) {
+                // Interface parameters are not the compilation unit's
+                skipPast("endinterface");
+            } else if (at("class") || (at("interface") && at("class", 1))) {
+                skipPast("endclass");
+            } else {
+                pos++;
+            }
+        }
+        return modules;
+    }
+};
+
+#endif
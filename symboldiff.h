@@ -0,0 +1,142 @@
+#ifndef SYMBOLDIFF_H
+#define SYMBOLDIFF_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include "csym.h"
+#include "imagecompare.h"
+
+// Renders the differences between two versions of a compiled symbol
+// library. Symbols are matched by name; one whose raster output is identical
+// in both versions is skipped, any other gets an overlay PNG of its new
+// version with added pins highlighted in green and removed ones, drawn at
+// their old position, in red.
+class SymbolDiff {
+    static constexpr double kMargin = 4;
+
+    const CsymFile& old_file;
+    const CsymFile& new_file;
+
+    static std::string pinKey(const CsymFile& file, const CsymPin& pin) {
+        return std::string(file.getString(pin.name)) + '\0' + file.getString(pin.type) + '\0' +
+               char('0'+pin.direction) + char('0'+pin.is_bus);
+    }
+
+    static std::unordered_set<std::string> pinKeys(const CsymFile* file, size_t index) {
+        std::unordered_set<std::string> keys;
+        if (file) {
+            file->forEachPin(index, [&](const CsymPin& pin) {
+                keys.insert(pinKey(*file, pin));
+            });
+        }
+        return keys;
+    }
+
+    static Cairo::RefPtr<Cairo::ImageSurface> createImage(double width, double height) {
+        auto image = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, std::ceil(width+2*kMargin), std::ceil(height+2*kMargin));
+        auto cr = Cairo::Context::create(image);
+        cr->set_source_rgb(1, 1, 1);
+        cr->paint();
+        return image;
+    }
+
+    static Cairo::RefPtr<Cairo::ImageSurface> rasterize(const CsymFile& file, size_t index, double width, double height) {
+        auto image = createImage(width, height);
+        auto cr = Cairo::Context::create(image);
+        cr->translate(kMargin, kMargin);
+        file.draw(cr, index);
+        return image;
+    }
+
+    static void highlightPin(Cairo::RefPtr<Cairo::Context> cr, const CsymPin& pin, double r, double g, double b) {
+        Cairo::Rectangle box = Pin::bounds(pin.pos, PinDirection(pin.direction), pin.name_extents, pin.type_extents);
+        cr->save();
+        cr->set_source_rgba(r, g, b, 0.3);
+        cr->rectangle(box.x-1, box.y-1, box.width+2, box.height+2);
+        cr->fill();
+        cr->restore();
+    }
+
+    // Either side may be missing, for added and removed symbols
+    Cairo::RefPtr<Cairo::ImageSurface> overlay(const CsymSymbol* old_symbol, size_t old_index,
+                                               const CsymSymbol* new_symbol, size_t new_index) const {
+        double width = std::max(old_symbol ? old_symbol->width : 0, new_symbol ? new_symbol->width : 0);
+        double height = std::max(old_symbol ? old_symbol->height : 0, new_symbol ? new_symbol->height : 0);
+        auto old_keys = pinKeys(old_symbol ? &old_file : nullptr, old_index);
+        auto new_keys = pinKeys(new_symbol ? &new_file : nullptr, new_index);
+
+        auto image = createImage(width, height);
+        auto cr = Cairo::Context::create(image);
+        cr->translate(kMargin, kMargin);
+        cr->set_source_rgb(0, 0, 0);
+        if (new_symbol) {
+            new_file.draw(cr, new_index);
+            new_file.forEachPin(new_index, [&](const CsymPin& pin) {
+                if (!old_keys.count(pinKey(new_file, pin))) {
+                    highlightPin(cr, pin, 0, 0.8, 0);
+                }
+            });
+        }
+        if (old_symbol) {
+            if (!new_symbol) {
+                cr->set_source_rgb(0.8, 0, 0);
+                old_file.draw(cr, old_index);
+            }
+            old_file.forEachPin(old_index, [&](const CsymPin& pin) {
+                if (!new_keys.count(pinKey(old_file, pin))) {
+                    cr->save();
+                    cr->set_source_rgb(0.8, 0, 0);
+                    old_file.drawPin(cr, pin);
+                    cr->restore();
+                    highlightPin(cr, pin, 0.8, 0, 0);
+                }
+            });
+        }
+        return image;
+    }
+
+public:
+    SymbolDiff(const CsymFile& _old_file, const CsymFile& _new_file) : old_file(_old_file), new_file(_new_file) { }
+
+    // Writes one overlay per changed symbol into directory and returns how many there were
+    size_t write(const std::string& directory) const {
+        std::filesystem::create_directories(directory);
+        std::unordered_map<std::string_view, size_t> old_index;
+        for (size_t i = 0; i < old_file.symbolCount(); i++) {
+            old_index.emplace(old_file.getString(old_file.getSymbol(i).name), i);
+        }
+
+        size_t changed = 0;
+        for (size_t i = 0; i < new_file.symbolCount(); i++) {
+            const CsymSymbol& symbol = new_file.getSymbol(i);
+            std::string_view name = new_file.getString(symbol.name);
+            auto it = old_index.find(name);
+            const CsymSymbol* old_symbol = nullptr;
+            size_t old_i = 0;
+            if (it != old_index.end()) {
+                old_i = it->second;
+                old_symbol = &old_file.getSymbol(old_i);
+                double width = std::max(old_symbol->width, symbol.width);
+                double height = std::max(old_symbol->height, symbol.height);
+                bool same = imagesEqual(rasterize(old_file, old_i, width, height), rasterize(new_file, i, width, height));
+                old_index.erase(it);
+                if (same) {
+                    continue;
+                }
+            }
+            overlay(old_symbol, old_i, &symbol, i)->write_to_png(directory + "/" + pngFileName(name));
+            changed++;
+        }
+
+        // Whatever is left was removed
+        for (const auto& removed: old_index) {
+            overlay(&old_file.getSymbol(removed.second), removed.second, nullptr, 0)->write_to_png(directory + "/" + pngFileName(removed.first));
+            changed++;
+        }
+        return changed;
+    }
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef SYMBOLVIEW_H
+#define SYMBOLVIEW_H
+
+#include <set>
+#include <vector>
+#include "cairo-symbol.h"
+#include "pinindex.h"
+
+// A symbol rendered into a retained image surface, for editors. After pins
+// of one section change, invalidateSection() works out which rectangles of
+// the previous and new layout differ and repaints only those, clipped, so the
+// cost follows the size of the change rather than the size of the symbol.
+// The symbol must outlive the view.
+class SymbolView {
+    static constexpr double kMargin = 2;
+
+    // Pins are compared by their box and hash, down each edge of the section
+    struct PinState {
+        Cairo::Rectangle box;
+        size_t hash;
+    };
+
+    struct SectionState {
+        double top, height;
+        std::vector<PinState> left, right;
+    };
+
+    const Symbol& symbol;
+    double scale;
+    RenderOptions options;
+    Cairo::RefPtr<Cairo::ImageSurface> surface;
+    PinIndex index;
+    Cairo::Rectangle frame;
+    double width, height;
+    std::vector<SectionState> sections;
+
+    static Cairo::Rectangle unite(const Cairo::Rectangle& a, const Cairo::Rectangle& b) {
+        double x = std::min(a.x, b.x), y = std::min(a.y, b.y);
+        return { x, y, std::max(a.x+a.width, b.x+b.width)-x, std::max(a.y+a.height, b.y+b.height)-y };
+    }
+
+    static bool sameBox(const Cairo::Rectangle& a, const Cairo::Rectangle& b) {
+        return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+    }
+
+    static bool intersects(const Cairo::Rectangle& a, const Cairo::Rectangle& b) {
+        return a.x <= b.x+b.width && b.x <= a.x+a.width && a.y <= b.y+b.height && b.y <= a.y+a.height;
+    }
+
+    SectionState measureSection(size_t index, double top) const {
+        const Section& section = symbol.getSection(index);
+        SectionState state { top, (double)section.height(), {}, {} };
+        Cairo::Rectangle pos = { frame.x, top, frame.width, state.height };
+        section.forEachPin(pos, [&](const Pin& pin, const Cairo::Rectangle& pin_rect) {
+            auto& column = (pin.getDirection() == IN) ? state.left : state.right;
+            column.push_back({ Pin::bounds(pin_rect, pin.getDirection(), pin.nameRun().extents, pin.typeRun().extents), pin.hash() });
+        });
+        return state;
+    }
+
+    void measure() {
+        frame = symbol.frame();
+        width = symbol.width();
+        height = symbol.height();
+        sections.clear();
+        double top = frame.y;
+        for (size_t i = 0; i < symbol.sectionCount(); i++) {
+            sections.push_back(measureSection(i, top));
+            top += sections.back().height;
+        }
+    }
+
+    Cairo::RefPtr<Cairo::Context> createContext() const {
+        auto cr = Cairo::Context::create(surface);
+        applyRasterProfile(cr, options);
+        cr->scale(scale, scale);
+        cr->translate(kMargin, kMargin);
+        return cr;
+    }
+
+    Cairo::Rectangle toDevice(const Cairo::Rectangle& r) const {
+        return { (r.x+kMargin)*scale, (r.y+kMargin)*scale, r.width*scale, r.height*scale };
+    }
+
+    // Clears the rectangles, in symbol coordinates, and draws everything that touches them
+    void repaint(const std::vector<Cairo::Rectangle>& dirty) {
+        auto cr = createContext();
+        for (const auto& r: dirty) {
+            cr->rectangle(r.x, r.y, r.width, r.height);
+        }
+        cr->clip();
+        cr->set_source_rgb(1, 1, 1);
+        cr->paint();
+        cr->set_source_rgb(0, 0, 0);
+
+        bool greeked = isGreeked(cr, options);
+        symbol.drawName(cr, frame, greeked);
+        symbol.forEachSection(frame, [&](const Section&, const Cairo::Rectangle& r) {
+            for (const auto& d: dirty) {
+                if (intersects(r, d)) {
+                    strokeRectangle(cr, r.x, r.y, r.width, r.height);
+                    break;
+                }
+            }
+        });
+        std::set<std::pair<size_t, size_t>> drawn;
+        for (const auto& d: dirty) {
+            for (const auto& hit: index.pinsIn(d)) {
+                if (drawn.insert({ hit.section, hit.pin }).second) {
+                    symbol.getSection(hit.section).getPin(hit.pin).draw(cr, hit.pos, greeked);
+                }
+            }
+        }
+        surface->flush();
+    }
+public:
+    SymbolView(const Symbol& _symbol, double _scale = 1, const RenderOptions& _options = RenderOptions()) :
+        symbol(_symbol), scale(_scale), options(_options), index(_symbol) {
+        redraw();
+    }
+
+    Cairo::RefPtr<Cairo::ImageSurface> getSurface() const {
+        return surface;
+    }
+
+    // Lays out and draws the whole symbol again, on a new surface if its size changed
+    void redraw() {
+        measure();
+        index.rebuild();
+        int surface_width = std::ceil((width+2*kMargin)*scale);
+        int surface_height = std::ceil((height+2*kMargin)*scale);
+        if (!surface || surface->get_width() != surface_width || surface->get_height() != surface_height) {
+            surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, std::max(1, surface_width), std::max(1, surface_height));
+        }
+        auto cr = createContext();
+        cr->set_source_rgb(1, 1, 1);
+        cr->paint();
+        cr->set_source_rgb(0, 0, 0);
+        symbol.draw(cr, options);
+        surface->flush();
+    }
+
+    // Call after the pins of one section changed or a section was added.
+    // Returns the repainted areas in surface pixels; a change that resizes
+    // the frame redraws the whole surface.
+    std::vector<Cairo::Rectangle> invalidateSection(size_t section) {
+        Cairo::Rectangle new_frame = symbol.frame();
+        if (new_frame.x != frame.x || new_frame.y != frame.y || new_frame.width != frame.width ||
+            new_frame.height != frame.height || section >= sections.size() || symbol.sectionCount() != sections.size()) {
+            redraw();
+            return { { 0, 0, (double)surface->get_width(), (double)surface->get_height() } };
+        }
+
+        // With the frame unchanged, the section kept its height and only its pins can differ
+        std::vector<Cairo::Rectangle> dirty;
+        SectionState state = measureSection(section, sections[section].top);
+        for (auto columns: { std::make_pair(&sections[section].left, &state.left),
+                             std::make_pair(&sections[section].right, &state.right) }) {
+            const auto& old_pins = *columns.first;
+            const auto& new_pins = *columns.second;
+            for (size_t i = 0; i < std::max(old_pins.size(), new_pins.size()); i++) {
+                if (i >= old_pins.size()) {
+                    dirty.push_back(new_pins[i].box);
+                } else if (i >= new_pins.size()) {
+                    dirty.push_back(old_pins[i].box);
+                } else if (old_pins[i].hash != new_pins[i].hash || !sameBox(old_pins[i].box, new_pins[i].box)) {
+                    dirty.push_back(unite(old_pins[i].box, new_pins[i].box));
+                }
+            }
+        }
+        sections[section] = std::move(state);
+
+        // One unit of slack for antialiased edges
+        for (auto& r: dirty) {
+            r = { r.x-1, r.y-1, r.width+2, r.height+2 };
+        }
+        index.updateSection(section);
+        if (!dirty.empty()) {
+            repaint(dirty);
+        }
+
+        std::vector<Cairo::Rectangle> device;
+        for (const auto& r: dirty) {
+            device.push_back(toDevice(r));
+        }
+        return device;
+    }
+};
+
+#endif
@@ -0,0 +1,58 @@
+// Block diagram wiring of nets that no output drives
+#include <algorithm>
+#include <cstdio>
+#include "../blockdiagram.h"
+
+static const char* const kSource = R"(
+module pad(inout wire p, inout wire c);
+endmodule
+
+module sink(input logic i);
+endmodule
+
+module buffer(input logic a, output logic y);
+endmodule
+
+module top(inout wire io0, inout wire io1, inout wire io2, input logic clk);
+  wire core, sense;
+  pad u0 (.p(io0), .c(core));
+  pad u1 (.p(io1), .c(core));
+  pad u2 (.p(io2), .c(core));
+  // Undefined, so every port is inout
+  analog_mux u3 (.a(core), .y(sense));
+  adc u4 (.vin(sense), .clk(clk));
+  sink u5 (.i(sense));
+  buffer u6 (.a(clk), .y(driven));
+  pad u7 (.p(driven), .c());
+endmodule
+)";
+
+static int failures = 0;
+
+static void expect(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+int main() {
+    std::vector<SvModule> modules = SvParser().parse(kSource);
+    auto top = std::find_if(modules.begin(), modules.end(), [](const SvModule& module) {
+        return module.name == "top";
+    });
+    expect(top != modules.end(), "top module parsed");
+    if (top == modules.end()) {
+        return 1;
+    }
+
+    SymbolLibrary library;
+    ModuleSymbols symbols(library, modules);
+    BlockDiagram diagram(*top, symbols);
+    expect(diagram.instanceCount() == 8, "every instance placed");
+    // core: u0-u1-u2-u3 chained; sense: u3-u4 chained and u3 to the input of
+    // u5; clk: u4 to the input of u6; driven: u6 drives u7. The io nets have
+    // one end each.
+    expect(diagram.wireCount() == 7, "inout-only nets wired");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Timeline of spans in the Chrome trace event format, for chrome://tracing
+// or ui.perfetto.dev. Nothing is recorded until start() is called, so the
+// spans compiled into the drawing code cost one relaxed load otherwise.
+class Tracer {
+    struct Event {
+        const char* name;
+        const char* category;
+        int64_t start, duration;
+        int thread;
+    };
+
+    std::atomic<bool> enabled{false};
+    std::atomic<int> threads{0};
+    std::chrono::steady_clock::time_point origin;
+    std::mutex mutex;
+    std::vector<Event> events;
+
+    Tracer() { }
+public:
+    // Only one in kSampling of the very frequent spans (pins, shaping) is recorded
+    static constexpr unsigned kSampling = 64;
+
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    void start() {
+        origin = std::chrono::steady_clock::now();
+        enabled = true;
+    }
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Nanoseconds since start()
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-origin).count();
+    }
+
+    // Small id of the calling thread, numbered in order of first use
+    int threadId() {
+        thread_local int id = ++threads;
+        return id;
+    }
+
+    // True for every kSampling-th call on this thread
+    static bool sample() {
+        thread_local unsigned count = 0;
+        return count++ % kSampling == 0;
+    }
+
+    void record(const char* name, const char* category, int64_t start, int64_t end) {
+        int thread = threadId();
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back({ name, category, start, end-start, thread });
+    }
+
+    void write(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        for (size_t i = 0; i < events.size(); i++) {
+            const Event& event = events[i];
+            out << (i ? ",\n" : "\n")
+                << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\""
+                << ",\"ts\":" << event.start/1000 << '.' << (event.start%1000)/100
+                << ",\"dur\":" << event.duration/1000 << '.' << (event.duration%1000)/100
+                << ",\"pid\":1,\"tid\":" << event.thread << "}";
+        }
+        out << "\n]}\n";
+    }
+};
+
+// Records the time from its construction to the end of its scope. Name and
+// category must be string literals.
+class TraceSpan {
+    const char* name;
+    const char* category;
+    int64_t start = -1;
+public:
+    TraceSpan(const char* _name, const char* _category, bool sampled = false) : name(_name), category(_category) {
+        Tracer& tracer = Tracer::instance();
+        if (tracer.isEnabled() && (!sampled || Tracer::sample())) {
+            start = tracer.now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (start >= 0) {
+            Tracer& tracer = Tracer::instance();
+            tracer.record(name, category, start, tracer.now());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef VHDLPARSE_H
+#define VHDLPARSE_H
+
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cairo-symbol.h"
+#include "svparse.h"
+
+// VHDL entity declarations, read into the same SvModule and SvPort records as
+// the SystemVerilog front-end so both feed one symbol path, and so VHDL
+// entities can stand in for modules instantiated from SystemVerilog.
+// Tokens are lexed on demand with a few tokens of look-ahead and nothing
+// else is kept, so architecture bodies and packages are skipped at the speed
+// of the lexer without ever being parsed.
+class VhdlParser {
+    enum TokenKind {
+        IDENTIFIER,
+        NUMBER,
+        STRING,
+        SYMBOL,
+        END
+    };
+
+    struct Token {
+        TokenKind kind;
+        std::string_view text;
+        int line;
+    };
+
+    static constexpr size_t kLookahead = 3;
+
+    std::string_view source;
+    size_t offset = 0;
+    int line = 1;
+    // Ring of lexed tokens not consumed yet
+    Token buffer[kLookahead];
+    size_t first = 0, buffered = 0;
+    // Decides whether a quote starts a character literal or an attribute
+    TokenKind last_kind = SYMBOL;
+    std::string_view last_text;
+
+    static bool isIdentifierChar(char c) {
+        return std::isalnum((unsigned char)c) || c == '_';
+    }
+
+    // VHDL is case insensitive; keyword is given in lower case
+    static bool equals(std::string_view word, std::string_view keyword) {
+        if (word.size() != keyword.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < word.size(); i++) {
+            if (std::tolower((unsigned char)word[i]) != keyword[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool equalsIgnoringCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Token lex() {
+        while (offset < source.size()) {
+            char c = source[offset];
+            if (c == '\n') {
+                line++;
+                offset++;
+            } else if (std::isspace((unsigned char)c)) {
+                offset++;
+            } else if (source.compare(offset, 2, "--") == 0) {
+                size_t end = source.find('\n', offset);
+                offset = (end == std::string_view::npos) ? source.size() : end;
+            } else if (source.compare(offset, 2, "/*") == 0) {
+                size_t end = source.find("*/", offset+2);
+                end = (end == std::string_view::npos) ? source.size() : end+2;
+                for (; offset < end; offset++) {
+                    line += source[offset] == '\n';
+                }
+            } else {
+                break;
+            }
+        }
+        if (offset >= source.size()) {
+            return { END, std::string_view(), line };
+        }
+
+        size_t start = offset;
+        char c = source[offset];
+        TokenKind kind = SYMBOL;
+        if (std::isalpha((unsigned char)c)) {
+            while (offset < source.size() && isIdentifierChar(source[offset])) {
+                offset++;
+            }
+            kind = IDENTIFIER;
+        } else if (c == '\\') {
+            // Extended identifier, with \\ standing for one backslash
+            offset++;
+            while (offset < source.size() && (source[offset] != '\\' || source.compare(offset, 2, "\\\\") == 0)) {
+                offset += (source[offset] == '\\') ? 2 : 1;
+            }
+            offset = std::min(offset+1, source.size());
+            kind = IDENTIFIER;
+        } else if (std::isdigit((unsigned char)c)) {
+            // Decimal and based literals such as 1_000, 2.5e3 or 16#FF#
+            while (offset < source.size() && (isIdentifierChar(source[offset]) || source[offset] == '.' || source[offset] == '#')) {
+                offset++;
+            }
+            kind = NUMBER;
+        } else if (c == '"') {
+            // "" stands for one quote inside a string
+            offset++;
+            while (offset < source.size() && (source[offset] != '"' || source.compare(offset, 2, "\"\"") == 0)) {
+                offset += (source[offset] == '"') ? 2 : 1;
+            }
+            offset = std::min(offset+1, source.size());
+            kind = STRING;
+        } else if (c == '\'' && offset+2 < source.size() && source[offset+2] == '\'' &&
+                   !(last_kind == IDENTIFIER || last_text == ")")) {
+            // Character literal; after a name or a bracket the quote is an attribute
+            offset += 3;
+            kind = STRING;
+        } else {
+            static const std::string_view pairs[] = { ":=", "<=", "=>", "/=", ">=", "**", "<>" };
+            offset++;
+            for (auto pair: pairs) {
+                if (source.compare(start, 2, pair) == 0) {
+                    offset++;
+                    break;
+                }
+            }
+        }
+        last_kind = kind;
+        last_text = source.substr(start, offset-start);
+        return { kind, last_text, line };
+    }
+
+    const Token& peek(size_t ahead = 0) {
+        while (buffered <= ahead) {
+            buffer[(first+buffered++)%kLookahead] = lex();
+        }
+        return buffer[(first+ahead)%kLookahead];
+    }
+
+    Token next() {
+        Token token = peek();
+        if (token.kind != END) {
+            first = (first+1)%kLookahead;
+            buffered--;
+        }
+        return token;
+    }
+
+    bool at(std::string_view keyword, size_t ahead = 0) {
+        const Token& token = peek(ahead);
+        return (token.kind == IDENTIFIER || token.kind == SYMBOL) && equals(token.text, keyword);
+    }
+
+    [[noreturn]] void fail(const std::string& message) {
+        throw std::runtime_error("line " + std::to_string(peek().line) + ": " + message);
+    }
+
+    void expect(std::string_view keyword) {
+        if (!at(keyword)) {
+            fail("expected '" + std::string(keyword) + "'");
+        }
+        next();
+    }
+
+    // Consumes tokens through the bracket matching the "(" just consumed
+    void skipBalanced() {
+        for (int depth = 1; depth > 0 && peek().kind != END; ) {
+            Token token = next();
+            if (token.kind == SYMBOL) {
+                depth += (token.text == "(") ? 1 : (token.text == ")") ? -1 : 0;
+            }
+        }
+    }
+
+    static bool directionOf(std::string_view word, PinDirection& direction) {
+        if (equals(word, "in")) {
+            direction = IN;
+        } else if (equals(word, "out") || equals(word, "buffer")) {
+            direction = OUT;
+        } else if (equals(word, "inout") || equals(word, "linkage")) {
+            direction = INOUT;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Index constraints such as (7 downto 0) and the vector types make a bus
+    static bool isBusType(std::string_view type) {
+        if (type.find('(') != std::string_view::npos) {
+            return true;
+        }
+        size_t dot = type.rfind('.');
+        std::string_view base = (dot == std::string_view::npos) ? type : type.substr(dot+1);
+        return equals(base, "unsigned") || equals(base, "signed") ||
+               (base.size() > 7 && equals(base.substr(base.size()-7), "_vector"));
+    }
+
+    // "[signal] a, b : [mode] subtype [:= default]" up to the ";" or ")" after it
+    void portDeclaration(SvModule& module) {
+        if (at("signal")) {
+            next();
+        }
+        size_t first_port = module.ports.size();
+        while (true) {
+            Token name = next();
+            if (name.kind != IDENTIFIER) {
+                fail("expected a port name");
+            }
+            module.ports.push_back({ std::string(name.text), IN, "", false });
+            if (!at(",")) {
+                break;
+            }
+            next();
+        }
+        expect(":");
+        PinDirection direction = IN;
+        if (peek().kind == IDENTIFIER && directionOf(peek().text, direction)) {
+            next();
+        }
+
+        // Type text with spaces only where words meet
+        std::string type;
+        bool word = false;
+        for (int depth = 0; peek().kind != END; ) {
+            const Token& token = peek();
+            if (token.kind == SYMBOL && depth == 0 && (token.text == ";" || token.text == ")" || token.text == ":=")) {
+                break;
+            }
+            if (token.kind == SYMBOL) {
+                depth += (token.text == "(") ? 1 : (token.text == ")") ? -1 : 0;
+            }
+            if (token.kind != SYMBOL && word) {
+                type += ' ';
+            }
+            word = token.kind != SYMBOL;
+            type += token.text;
+            next();
+        }
+        if (type.empty()) {
+            fail("port without a type");
+        }
+        if (at(":=")) {
+            // Default values are not drawn
+            for (int depth = 0; peek().kind != END; next()) {
+                const Token& token = peek();
+                if (token.kind == SYMBOL && depth == 0 && (token.text == ";" || token.text == ")")) {
+                    break;
+                }
+                if (token.kind == SYMBOL) {
+                    depth += (token.text == "(") ? 1 : (token.text == ")") ? -1 : 0;
+                }
+            }
+        }
+        bool is_bus = isBusType(type);
+        for (size_t i = first_port; i < module.ports.size(); i++) {
+            module.ports[i].direction = direction;
+            module.ports[i].type = type;
+            module.ports[i].is_bus = is_bus;
+        }
+    }
+
+    // "entity name is [generic (...);] [port (...);] ... end [entity] [name];"
+    SvModule entity() {
+        expect("entity");
+        SvModule module;
+        module.name = std::string(next().text);
+        expect("is");
+        if (at("generic")) {
+            next();
+            expect("(");
+            skipBalanced();
+            expect(";");
+        }
+        if (at("port")) {
+            next();
+            expect("(");
+            while (!at(")")) {
+                portDeclaration(module);
+                if (at(";")) {
+                    next();
+                } else if (!at(")")) {
+                    fail("expected ';' or ')'");
+                }
+            }
+            next();
+            expect(";");
+        }
+
+        // Declarations and passive statements of the entity are not needed
+        while (peek().kind != END) {
+            if (at("end") && (at(";", 1) || at("entity", 1) || equalsIgnoringCase(peek(1).text, module.name))) {
+                break;
+            }
+            next();
+        }
+        expect("end");
+        while (peek().kind != END && !at(";")) {
+            next();
+        }
+        expect(";");
+        return module;
+    }
+public:
+    // Entities declared in source; throws std::runtime_error on malformed declarations
+    std::vector<SvModule> parse(std::string_view _source) {
+        source = _source;
+        offset = 0;
+        line = 1;
+        first = buffered = 0;
+        last_kind = SYMBOL;
+        last_text = std::string_view();
+        std::vector<SvModule> entities;
+        while (peek().kind != END) {
+            // "entity work.name" in an architecture instantiates rather than declares
+            if (at("entity") && peek(1).kind == IDENTIFIER && at("is", 2)) {
+                entities.push_back(entity());
+            } else {
+                next();
+            }
+        }
+        return entities;
+    }
+};
+
+#endif